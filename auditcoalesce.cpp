@@ -0,0 +1,119 @@
+#include "knox/coalescer.h"
+#include "knox/sampler.h"
+#include "knox/stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+static auto usage() {
+  fprintf(stderr,
+          "usage: auditcoalesce [-w <window-ms>] [-n <entries>] [<audit-log>]\n"
+          "\n"
+          "  -w  coalesce identical events within this window (default 1000)\n"
+          "  -n  the most events pending at once (default 65536)\n");
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+  knox::stats::init(argc, argv);
+
+  u_int64_t window = 1000;
+  size_t capacity = 1 << 16;
+
+  int option;
+  while ((option = getopt(argc, argv, "w:n:h")) != -1) {
+    switch (option) {
+    case 'w':
+      window = strtoull(optarg, nullptr, 10);
+      break;
+    case 'n':
+      capacity = strtoul(optarg, nullptr, 10);
+      if (capacity == 0) {
+        return usage();
+      }
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  if (argc - optind > 1) {
+    return usage();
+  }
+
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "error: cannot print to stdout, try piping to praudit\n");
+    return EXIT_FAILURE;
+  }
+
+  knox::Reader input = optind < argc ? knox::Reader::open(argv[optind])
+                                     : knox::Reader{STDIN_FILENO, false};
+  if (input.error()) {
+    perror("error");
+    return EXIT_FAILURE;
+  }
+
+  // Sample as configured by KNOX_SAMPLE, for example "fr=0.01,pid-rate=100".
+  auto sampler = knox::Sampler::fromEnvironment();
+  input.setSampler(sampler.get());
+  if (sampler) {
+    knox::stopOnInterrupt();
+  }
+
+  knox::Coalescer coalescer{window, capacity, [](const knox::Record &record) {
+                              knox::stats::Timer timer{knox::stats::Output};
+                              auto write_size = write(
+                                  STDOUT_FILENO, record.data(), record.size());
+                              return write_size == (ssize_t)record.size();
+                            }};
+
+  // Wake up when input is idle, to emit records whose window has passed,
+  // rather than hold them until more input arrives.
+  const auto timeout =
+      std::min<u_int64_t>(std::max<u_int64_t>(window, 10), 1000);
+  input.setTimeout(timeout);
+
+  // Idle, record time advances from the last record's by the time input has
+  // been idle, rather than jumping to the current time, which would expire
+  // everything pending of a replayed older log. Idle time is counted in
+  // timeouts, which avoids reading the clock per record.
+  u_int64_t idle = 0;
+  knox::Record record;
+  bool written = true;
+  while (written && not knox::interrupted()) {
+    if (input.next(record)) {
+      idle = 0;
+      knox::stats::Timer timer{knox::stats::Match};
+      written = coalescer.add(record);
+    } else if (input.error() == ETIMEDOUT) {
+      idle += timeout;
+      written = coalescer.expire(coalescer.now() + idle);
+    } else {
+      break;
+    }
+  }
+  written = written && coalescer.flush();
+
+  if (not written) {
+    perror("error: failed to write to stdout");
+    return EXIT_FAILURE;
+  }
+
+  if (input.error() && not knox::interrupted()) {
+    errno = input.error();
+    perror("error");
+    return EXIT_FAILURE;
+  }
+
+  if (sampler) {
+    sampler->report(stderr);
+  }
+  fprintf(stderr, "coalesced %llu records into %llu\n",
+          (unsigned long long)coalescer.inputCount(),
+          (unsigned long long)coalescer.outputCount());
+
+  return EXIT_SUCCESS;
+}
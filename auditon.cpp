@@ -1,9 +1,15 @@
+#include "knox/auditpipe.h"
+#include "knox/classes.h"
+
 #include <bsm/libbsm.h>
+#include <cerrno>
 #include <cstdlib>
 #include <unistd.h>
 
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 enum class Command {
   GETPOLICY,
@@ -14,7 +20,9 @@ enum class Command {
   UNSETMASK,
   GETCLASS,
   SETCLASS,
-  UNSETCLASS
+  UNSETCLASS,
+  PROFILE,
+  UNPROFILE
 };
 
 static auto usage() {
@@ -26,7 +34,9 @@ static auto usage() {
                   "       auditon unsetmask <pid> <event-classes>\n"
                   "       auditon getclass <event-name>\n"
                   "       auditon setclass <event-name> <event-class>\n"
-                  "       auditon unsetclass <event-name> <event-class>\n");
+                  "       auditon unsetclass <event-name> <event-class>\n"
+                  "       auditon profile <event-name> [<event-name>...]\n"
+                  "       auditon unprofile <class-mask>\n");
   return EXIT_FAILURE;
 }
 
@@ -36,7 +46,8 @@ int main(int argc, char **argv) {
       {"unsetpolicy", Command::UNSETPOLICY}, {"getmask", Command::GETMASK},
       {"setmask", Command::SETMASK},         {"unsetmask", Command::UNSETMASK},
       {"getclass", Command::GETCLASS},       {"setclass", Command::SETCLASS},
-      {"unsetclass", Command::UNSETCLASS},
+      {"unsetclass", Command::UNSETCLASS},   {"profile", Command::PROFILE},
+      {"unprofile", Command::UNPROFILE},
   };
 
   if (argc <= 1) {
@@ -263,62 +274,95 @@ int main(int argc, char **argv) {
       return EXIT_FAILURE;
     }
 
-    au_evclass_map_t evc_map;
-    auto event_num = getauevnonam(argv[2]);
-    if (not event_num) {
+    if (not knox::addEventClass(argv[2], argv[3])) {
       perror("error");
       return EXIT_FAILURE;
     }
+    break;
+  }
+  case Command::UNSETCLASS: {
+    if (argc != 4) {
+      fprintf(stderr,
+              "usage: auditon unsetclass <event-name> <event-classes>\n");
+      return EXIT_FAILURE;
+    }
 
-    evc_map.ec_number = *event_num;
-    if (audit_get_class(&evc_map, sizeof(evc_map))) {
+    if (not knox::removeEventClass(argv[2], argv[3])) {
       perror("error");
       return EXIT_FAILURE;
     }
+    break;
+  }
+  case Command::PROFILE: {
+    if (argc < 3) {
+      fprintf(stderr,
+              "usage: auditon profile <event-name> [<event-name>...]\n");
+      return EXIT_FAILURE;
+    }
 
-    const auto class_name = argv[3];
-    auto class_ent = getauclassnam(class_name);
-    if (not class_ent) {
+    // Maps exactly the given events to a new, otherwise unused, class. The
+    // class mask can then be used to preselect only these events, for example
+    // `auditpipe +<class-mask>`.
+    std::vector<knox::AuditClass> classes;
+    std::vector<knox::AuditEvent> events;
+    if (not knox::loadAuditEvents(classes, events)) {
       perror("error");
       return EXIT_FAILURE;
     }
 
-    evc_map.ec_class |= class_ent->ac_class;
-    if (audit_set_class(&evc_map, sizeof(evc_map))) {
+    auto class_bit = knox::unusedClassBit(classes, events);
+    if (class_bit == 0) {
+      fprintf(stderr, "error: no unused event class\n");
+      return EXIT_FAILURE;
+    }
+
+    std::vector<au_evclass_map_t> mappings;
+    std::string unknown;
+    if (not knox::profileMappings(events, {argv + 2, argv + argc}, class_bit,
+                                  mappings, unknown)) {
+      fprintf(stderr, "error: unknown event: %s\n", unknown.c_str());
+      return EXIT_FAILURE;
+    }
+
+    // Doesn't leave a partial profile on failure.
+    if (not knox::applyProfile(std::move(mappings), class_bit)) {
       perror("error");
       return EXIT_FAILURE;
     }
+
+    printf("0x%08x\n", class_bit);
     break;
   }
-  case Command::UNSETCLASS: {
-    if (argc != 4) {
-      fprintf(stderr,
-              "usage: auditon unsetclass <event-name> <event-classes>\n");
+  case Command::UNPROFILE: {
+    if (argc != 3) {
+      fprintf(stderr, "usage: auditon unprofile <class-mask>\n");
       return EXIT_FAILURE;
     }
 
-    au_evclass_map_t evc_map;
-    auto event_num = getauevnonam(argv[2]);
-    if (not event_num) {
-      perror("error");
+    char *end;
+    auto class_bit = (au_class_t)strtoul(argv[2], &end, 16);
+    if (*end != '\0' || __builtin_popcount(class_bit) != 1) {
+      fprintf(stderr, "error: invalid class mask: %s\n", argv[2]);
       return EXIT_FAILURE;
     }
 
-    evc_map.ec_number = *event_num;
-    if (audit_get_class(&evc_map, sizeof(evc_map))) {
+    std::vector<knox::AuditClass> classes;
+    std::vector<knox::AuditEvent> events;
+    if (not knox::loadAuditEvents(classes, events)) {
       perror("error");
       return EXIT_FAILURE;
     }
 
-    const auto class_name = argv[3];
-    auto class_ent = getauclassnam(class_name);
-    if (not class_ent) {
-      perror("error");
+    // Only bits made by `profile`, not those of the system's classes.
+    if (auto audit_class = knox::findAuditClass(classes, class_bit)) {
+      fprintf(stderr, "error: 0x%08x is the %s class, not a profile\n",
+              class_bit, audit_class->name.c_str());
       return EXIT_FAILURE;
     }
 
-    evc_map.ec_class &= ~class_ent->ac_class;
-    if (audit_set_class(&evc_map, sizeof(evc_map))) {
+    size_t applied;
+    if (not knox::setEventClasses(knox::unprofileMappings(events, class_bit),
+                                  applied)) {
       perror("error");
       return EXIT_FAILURE;
     }
@@ -1,9 +1,17 @@
+#include "knox/auditpipe.h"
+#include "knox/classes.h"
+#include "knox/sampler.h"
+#include "knox/spill.h"
+#include "knox/stats.h"
+
 #include <bsm/libbsm.h>
 #include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
+#include <memory>
 #include <security/audit/audit_ioctl.h>
 #include <signal.h>
+#include <string>
 #include <sys/errno.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -14,7 +22,20 @@ static auto config_failure() {
 }
 
 static bool keep_running = true;
-static void stop_running(int _signal) { keep_running = false; }
+static void stop_running(int _signal) {
+  keep_running = false;
+  // A second interrupt exits, even while waiting on a stalled consumer.
+  signal(SIGINT, SIG_DFL);
+}
+
+// Writes to stdout, through the spill ring if there is one.
+static ssize_t writeOutput(knox::SpillWriter *spill, const void *data,
+                           size_t size) {
+  if (spill) {
+    return spill->write(data, size) ? size : -1;
+  }
+  return write(STDOUT_FILENO, data, size);
+}
 
 #define break_or_fail(MESSAGE)                                                 \
   if (errno == EINTR) {                                                        \
@@ -24,25 +45,73 @@ static void stop_running(int _signal) { keep_running = false; }
   return EXIT_FAILURE;
 
 int main(int argc, char **argv) {
-  if (argc != 2 || strcmp(argv[1], "-h") == 0) {
+  knox::stats::init(argc, argv);
+
+  // Not getopt, because event classes can start with '-'. Options, each with
+  // a value, come before the event classes.
+  const char *sample_spec = nullptr;
+  const char *spill_path = nullptr;
+  u_int64_t spill_megabytes = 1024;
+  int arg = 1;
+  bool valid = argc >= 2;
+  for (; valid && arg + 1 < argc; arg += 2) {
+    if (strcmp(argv[arg], "-s") == 0) {
+      sample_spec = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-S") == 0) {
+      spill_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-m") == 0) {
+      spill_megabytes = strtoull(argv[arg + 1], nullptr, 10);
+      valid = spill_megabytes > 0;
+    } else {
+      valid = false;
+    }
+  }
+  if (not valid || arg != argc - 1 || strcmp(argv[arg], "-h") == 0) {
     fprintf(stderr,
             "usage:\n"
-            "\t%s <event-classes> | praudit\n"
-            "\t%s <event-classes> > /path/to/log\n",
+            "\t%s [<options>] <event-classes> | praudit\n"
+            "\t%s [<options>] <event-classes> > /path/to/log\n"
+            "\n"
+            "  -s <sample-spec>  sample high volume events\n"
+            "  -S <spill-file>   spill to this file while stdout is stalled\n"
+            "  -m <megabytes>    the size of the spill file (default 1024)\n",
             argv[0], argv[0]);
     return EXIT_FAILURE;
   }
 
-  const auto event_classes = argv[1];
+  const auto event_classes = argv[argc - 1];
   au_mask_t masks;
-  if (getauditflagsbin(event_classes, &masks)) {
+  if (not knox::parseEventClasses(event_classes, masks)) {
     perror("error: unknown event class");
     return EXIT_FAILURE;
   }
 
+  auto sampler = knox::Sampler::fromEnvironment();
+  if (sample_spec) {
+    sampler.reset(new knox::Sampler);
+    std::string error;
+    if (not sampler->configure(sample_spec, error)) {
+      fprintf(stderr, "error: invalid sample spec: %s\n", error.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
   if (geteuid() != 0) {
     // Re-exec with sudo.
-    const char *cmd[] = {"sudo", argv[0], argv[1], nullptr};
+    const char *cmd[argc + 4];
+    int count = 0;
+    cmd[count++] = "sudo";
+    // sudo resets the environment, which would drop the sample spec.
+    if (getenv("KNOX_SAMPLE")) {
+      cmd[count++] = "--preserve-env=KNOX_SAMPLE";
+    }
+    for (int i = 0; i < argc; ++i) {
+      cmd[count++] = argv[i];
+    }
+    if (knox::stats::enabled()) {
+      cmd[count++] = "--stats";
+    }
+    cmd[count] = nullptr;
     execvp("sudo", (char **)cmd);
   }
 
@@ -52,27 +121,17 @@ int main(int argc, char **argv) {
   }
 
   auto pipe = open("/dev/auditpipe", O_RDONLY);
-  if (not pipe) {
+  if (pipe == -1) {
     perror("error: could not open /dev/auditpipe");
     return EXIT_FAILURE;
   }
-
-  //
-  // See man auditpipe for details on these auditpipe ioctls.
-
-  int mode = AUDITPIPE_PRESELECT_MODE_LOCAL;
-  if (ioctl(pipe, AUDITPIPE_SET_PRESELECT_MODE, &mode)) {
+  if (not knox::configureAuditpipe(pipe, masks)) {
     return config_failure();
   }
 
-  // Increase the event queue to the largest maximum size.
+  // The queue limit, which has been increased to its maximum size.
   u_int max_qlimit;
-  if (ioctl(pipe, AUDITPIPE_GET_QLIMIT_MAX, &max_qlimit) ||
-      ioctl(pipe, AUDITPIPE_SET_QLIMIT, &max_qlimit)) {
-    return config_failure();
-  }
-
-  if (ioctl(pipe, AUDITPIPE_SET_PRESELECT_FLAGS, &masks)) {
+  if (ioctl(pipe, AUDITPIPE_GET_QLIMIT, &max_qlimit)) {
     return config_failure();
   }
 
@@ -81,31 +140,92 @@ int main(int argc, char **argv) {
     return config_failure();
   }
 
-  struct sigaction act;
+  struct sigaction act {};
   act.sa_handler = stop_running;
   sigaction(SIGINT, &act, nullptr);
 
   auto buffer_size = max_audit_record_size * max_qlimit;
-  auto buffer = new char[buffer_size];
 
-  while (keep_running) {
-    auto read_size = read(pipe, buffer, buffer_size);
-    if (read_size == -1) {
-      break_or_fail("error: failed to read from /dev/auditpipe");
+  // The kernel's queue absorbs short stalls of the consumer. For longer ones,
+  // for example while a log shipper restarts, output is spilled to disk.
+  knox::SpillRing spill_ring;
+  std::unique_ptr<knox::SpillWriter> spill;
+  if (spill_path) {
+    if (not spill_ring.open(spill_path, spill_megabytes << 20)) {
+      perror("error: could not open spill file");
+      return EXIT_FAILURE;
     }
+    spill.reset(new knox::SpillWriter{STDOUT_FILENO, spill_ring});
+  }
 
-    auto write_size = write(STDOUT_FILENO, buffer, read_size);
-    if (write_size == -1) {
-      break_or_fail("error: failed to write to stdout");
+  if (sampler) {
+    // Sampling needs record boundaries, so read record by record, and drop
+    // records right after they're read.
+    knox::Reader input{pipe, false, buffer_size};
+    input.setSampler(sampler.get());
+    knox::Record record;
+    while (keep_running && input.next(record)) {
+      knox::stats::Timer timer{knox::stats::Output};
+      auto write_size =
+          writeOutput(spill.get(), record.data(), record.size());
+      if (write_size == -1) {
+        break_or_fail("error: failed to write to stdout");
+      }
+
+      if ((size_t)write_size != record.size()) {
+        fprintf(stderr, "error: incomplete write to stdout");
+        return EXIT_FAILURE;
+      }
     }
 
-    if (write_size != read_size) {
-      fprintf(stderr, "error: incomplete write to stdout");
+    if (input.error() && input.error() != EINTR) {
+      errno = input.error();
+      perror("error: failed to read from /dev/auditpipe");
       return EXIT_FAILURE;
     }
+  } else {
+    auto buffer = new char[buffer_size];
+
+    while (keep_running) {
+      ssize_t read_size;
+      {
+        knox::stats::Timer timer{knox::stats::Read};
+        read_size = read(pipe, buffer, buffer_size);
+      }
+      if (read_size == -1) {
+        break_or_fail("error: failed to read from /dev/auditpipe");
+      }
+      knox::stats::count(knox::stats::Bytes, read_size);
+
+      knox::stats::Timer timer{knox::stats::Output};
+      auto write_size = writeOutput(spill.get(), buffer, read_size);
+      if (write_size == -1) {
+        break_or_fail("error: failed to write to stdout");
+      }
+
+      if (write_size != read_size) {
+        fprintf(stderr, "error: incomplete write to stdout");
+        return EXIT_FAILURE;
+      }
+    }
+
+    delete[] buffer;
   }
 
-  delete[] buffer;
+  if (spill) {
+    // Write what's left in the spill file, before exiting.
+    if (not spill->finish()) {
+      perror("error: failed to write to stdout");
+      return EXIT_FAILURE;
+    }
+    fprintf(stderr,
+            "\nspilled %llu bytes, high-water %llu of %llu bytes, full %llu "
+            "times\n",
+            (unsigned long long)spill_ring.spilled(),
+            (unsigned long long)spill_ring.highWater(),
+            (unsigned long long)spill_ring.capacity(),
+            (unsigned long long)spill->fullCount());
+  }
 
   u_int64_t drop_count;
   if (ioctl(pipe, AUDITPIPE_GET_DROPS, &drop_count) == 0) {
@@ -115,5 +235,9 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (sampler) {
+    sampler->report(stderr);
+  }
+
   return EXIT_SUCCESS;
 }
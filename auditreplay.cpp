@@ -0,0 +1,380 @@
+#include "knox/builder.h"
+#include "knox/record.h"
+#include "knox/stats.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+static auto usage() {
+  fprintf(stderr,
+          "usage: auditreplay [-r <rate>] [-q <qlimit>] [-o <fifo-or-socket>] "
+          "[<audit-log>...]\n"
+          "       auditreplay [-r <rate>] [-q <qlimit>] [-o <fifo-or-socket>] "
+          "-s <record-count>\n"
+          "\n"
+          "  -r  replay rate: 1 for real-time (default), 10x for ten times "
+          "faster, or max\n"
+          "  -q  emulate the /dev/auditpipe queue limit, dropping records "
+          "when it is full\n"
+          "  -o  write to a FIFO or unix socket, instead of stdout\n"
+          "  -s  replay a synthetic trail of process and file events\n");
+  return EXIT_FAILURE;
+}
+
+static std::atomic<bool> keep_running{true};
+static void stop_running(int _signal) { keep_running = false; }
+
+// Writes a whole record, resuming partial writes. FIFOs and stream sockets
+// don't keep record boundaries, readers reassemble records from the bytes,
+// like knox::Reader does.
+static bool writeRecord(int fd, const u_char *data, size_t size) {
+  while (size > 0) {
+    auto write_size = write(fd, data, size);
+    if (write_size == -1) {
+      if (errno == EINTR && keep_running) {
+        continue;
+      }
+      return false;
+    }
+    data += write_size;
+    size -= write_size;
+  }
+  return true;
+}
+
+static int openOutput(const char *path) {
+  struct stat info;
+  if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return -1;
+    }
+    if (connect(fd, (sockaddr *)&address, sizeof(address))) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // Opening a FIFO blocks until there's a reader.
+  return open(path, O_WRONLY);
+}
+
+// A bounded record queue, which like the kernel's auditpipe queue drops
+// records when it is full, rather than blocking the producer.
+class Queue {
+public:
+  explicit Queue(size_t limit) : _slots(limit) {}
+
+  // Returns false if the record was dropped.
+  bool push(const knox::Record &record) {
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (_count == _slots.size()) {
+      return false;
+    }
+
+    auto &slot = _slots[(_head + _count) % _slots.size()];
+    slot.assign(record.data(), record.data() + record.size());
+    ++_count;
+    _ready.notify_one();
+    return true;
+  }
+
+  // Waits for the next record. The slot's buffer is swapped into `record`,
+  // so buffers are reused rather than reallocated. Returns false once the
+  // queue is closed and empty.
+  bool pop(std::vector<u_char> &record) {
+    std::unique_lock<std::mutex> lock{_mutex};
+    _ready.wait(lock, [this] { return _count > 0 || _closed; });
+    if (_count == 0) {
+      return false;
+    }
+
+    record.swap(_slots[_head]);
+    _head = (_head + 1) % _slots.size();
+    --_count;
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock{_mutex};
+    _closed = true;
+    _ready.notify_one();
+  }
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::vector<std::vector<u_char>> _slots;
+  size_t _head = 0;
+  size_t _count = 0;
+  bool _closed = false;
+};
+
+// Generates the records of a build: a parent process that repeatedly spawns
+// a compiler, which stats some headers and exits. Records are one
+// millisecond apart.
+class Synthesizer {
+public:
+  explicit Synthesizer(u_int64_t count)
+      : _remaining(count), _time(time(nullptr) * 1000ull) {}
+
+  bool next(knox::Record &record) {
+    if (_remaining == 0) {
+      return false;
+    }
+    --_remaining;
+
+    const auto seconds = _time / 1000;
+    const auto milliseconds = _time % 1000;
+    ++_time;
+
+    static const char *headers[] = {
+        "/usr/include/stdio.h",
+        "/usr/include/stdlib.h",
+        "/usr/include/string.h",
+        "/usr/include/unistd.h",
+    };
+    const int headers_count = sizeof(headers) / sizeof(*headers);
+
+    char source[32];
+    snprintf(source, sizeof(source), "file%d.c", _child);
+    const char *args[] = {"/usr/bin/cc", "-c", source};
+
+    if (_step == 0) {
+      _builder.begin(AUE_POSIX_SPAWN, seconds, milliseconds);
+      _builder.arg32(0, _child, "child PID");
+      _builder.execArgs(args, 3);
+      _builder.path(args[0]);
+      _builder.subject32(_parent, 501, 20);
+      _builder.return32(0, 0);
+    } else if (_step <= headers_count) {
+      _builder.begin(AUE_STAT, seconds, milliseconds);
+      _builder.path(headers[_step - 1]);
+      _builder.subject32(_child, 501, 20);
+      _builder.return32(0, 0);
+    } else {
+      _builder.begin(AUE_EXIT, seconds, milliseconds);
+      _builder.exit(0, 0);
+      _builder.subject32(_child, 501, 20);
+      _builder.return32(0, 0);
+    }
+
+    if (++_step > headers_count + 1) {
+      _step = 0;
+      ++_child;
+    }
+
+    record = _builder.finish();
+    return true;
+  }
+
+private:
+  knox::RecordBuilder _builder;
+  u_int64_t _remaining;
+  u_int64_t _time;
+  pid_t _parent = 1000;
+  pid_t _child = 1001;
+  int _step = 0;
+};
+
+int main(int argc, char **argv) {
+  knox::stats::init(argc, argv);
+
+  double scale = 1;
+  size_t qlimit = 0;
+  const char *output_path = nullptr;
+  u_int64_t synthetic_count = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "r:q:o:s:h")) != -1) {
+    switch (option) {
+    case 'r':
+      if (strcmp(optarg, "max") == 0) {
+        scale = 0;
+      } else {
+        // Accepts both "10" and "10x".
+        char *end;
+        scale = strtod(optarg, &end);
+        if (scale <= 0 || (*end != '\0' && strcmp(end, "x") != 0)) {
+          fprintf(stderr, "error: invalid rate: %s\n", optarg);
+          return usage();
+        }
+      }
+      break;
+    case 'q':
+      qlimit = strtoul(optarg, nullptr, 10);
+      if (qlimit == 0) {
+        fprintf(stderr, "error: invalid queue limit: %s\n", optarg);
+        return usage();
+      }
+      break;
+    case 'o':
+      output_path = optarg;
+      break;
+    case 's':
+      synthetic_count = strtoull(optarg, nullptr, 10);
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  auto output = output_path ? openOutput(output_path) : STDOUT_FILENO;
+  if (output == -1) {
+    perror("error: could not open output");
+    return EXIT_FAILURE;
+  }
+
+  if (isatty(output)) {
+    fprintf(stderr, "error: cannot print to stdout, try piping to praudit\n");
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction act {};
+  act.sa_handler = stop_running;
+  sigaction(SIGINT, &act, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  //
+  // The source is either a synthetic trail, the given audit logs, or stdin.
+  Synthesizer synthesizer{synthetic_count};
+  auto paths = argv + optind;
+  auto paths_count = argc - optind;
+  knox::Reader reader = paths_count > 0 ? knox::Reader::open(*paths++)
+                                        : knox::Reader{STDIN_FILENO, false};
+  auto next = [&](knox::Record &record) {
+    if (synthetic_count > 0) {
+      return synthesizer.next(record);
+    }
+
+    while (not reader.next(record)) {
+      if (reader.error() || --paths_count <= 0) {
+        return false;
+      }
+      reader = knox::Reader::open(*paths++);
+    }
+    return true;
+  };
+
+  std::atomic<int> write_error{0};
+  u_int64_t records_count = 0;
+  u_int64_t bytes_count = 0;
+  u_int64_t drop_count = 0;
+
+  Queue queue{qlimit > 0 ? qlimit : 1};
+  std::thread writer;
+  if (qlimit > 0) {
+    writer = std::thread{[&] {
+      std::vector<u_char> record;
+      while (queue.pop(record)) {
+        if (not writeRecord(output, record.data(), record.size())) {
+          write_error = errno;
+          keep_running = false;
+          return;
+        }
+      }
+    }};
+  }
+
+  //
+  // Replay records at their recorded times, relative to the first record,
+  // scaled by the rate. Records without a header time are not delayed.
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  bool have_base = false;
+  u_int64_t base_time = 0;
+
+  knox::Record record;
+  while (keep_running && next(record)) {
+    u_int64_t seconds, milliseconds;
+    if (scale > 0 && record.time(seconds, milliseconds)) {
+      auto time = seconds * 1000 + milliseconds;
+      if (not have_base) {
+        have_base = true;
+        base_time = time;
+      }
+      if (time > base_time) {
+        auto offset = std::chrono::duration<double, std::milli>(
+            (time - base_time) / scale);
+        // In slices, because SIGINT doesn't interrupt sleep_until.
+        const auto until =
+            start + std::chrono::duration_cast<clock::duration>(offset);
+        const auto slice = std::chrono::milliseconds{100};
+        while (keep_running && clock::now() + slice < until) {
+          std::this_thread::sleep_for(slice);
+        }
+        if (not keep_running) {
+          break;
+        }
+        std::this_thread::sleep_until(until);
+      }
+    }
+
+    ++records_count;
+    bytes_count += record.size();
+    knox::stats::Timer timer{knox::stats::Output};
+    if (qlimit > 0) {
+      if (not queue.push(record)) {
+        ++drop_count;
+      }
+    } else if (not writeRecord(output, record.data(), record.size())) {
+      write_error = errno;
+      break;
+    }
+  }
+
+  if (qlimit > 0) {
+    queue.close();
+    writer.join();
+  }
+
+  const auto elapsed =
+      std::chrono::duration<double>(clock::now() - start).count();
+
+  // A closed pipe means the consumer exited, which is not an error.
+  const bool write_failed =
+      write_error && write_error != EPIPE && write_error != EINTR;
+  if (write_failed) {
+    errno = write_error;
+    perror("error: failed to write output");
+  }
+
+  if (reader.error() && synthetic_count == 0) {
+    errno = reader.error();
+    perror("error: failed to read input");
+  }
+
+  // Use \n prefix because an interrupt prints a bare "^C".
+  fprintf(stderr, "\nreplayed %llu records (%llu bytes) in %.3fs, %.0f/s\n",
+          (unsigned long long)records_count, (unsigned long long)bytes_count,
+          elapsed, elapsed > 0 ? records_count / elapsed : 0.0);
+  if (drop_count > 0) {
+    fprintf(stderr, "warning: %llu dropped audit events\n",
+            (unsigned long long)drop_count);
+  }
+
+  return write_failed || (reader.error() && synthetic_count == 0)
+             ? EXIT_FAILURE
+             : EXIT_SUCCESS;
+}
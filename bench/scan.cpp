@@ -0,0 +1,359 @@
+// Compares per-record token scanning strategies, over an audit log or a
+// synthetic trail:
+//
+//   multimap  every token decoded and copied into a multimap (paudit before)
+//   switch    every token decoded, then a runtime switch
+//   scanner   knox::TokenScanner, decoding only the wanted tokens
+//
+// And strategies to filter exec records, and read their args, like commands:
+//
+//   record    knox::ExecEvent of every record
+//   batch     knox::RecordBatch event column filter, then knox::ExecEvent
+//
+// Before measuring, the batch columns are checked against decoding each
+// record with knox::TokenScanner.
+//
+// usage: bench/scan [<audit-log>]
+
+#include "knox/batch.h"
+#include "knox/builder.h"
+#include "knox/events.h"
+#include "knox/tokens.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Records of an `all` class trail: mostly file events, with some process
+// events between them.
+static std::vector<u_char> synthesize(int count) {
+  std::vector<u_char> trail;
+  knox::RecordBuilder builder;
+  const char *args[] = {"/usr/bin/cc", "-c", "-o", "main.o", "main.c"};
+  for (int i = 0; i < count; ++i) {
+    const pid_t pid = 1000 + i / 50;
+    switch (i % 50) {
+    case 0:
+      builder.begin(AUE_POSIX_SPAWN, i / 1000, i % 1000);
+      builder.arg32(0, pid, "child PID");
+      builder.execArgs(args, 5);
+      builder.path(args[0]);
+      builder.path(args[0]);
+      builder.subject32(pid - 1, 501, 20);
+      builder.return32(0, 0);
+      break;
+    case 49:
+      builder.begin(AUE_EXIT, i / 1000, i % 1000);
+      builder.exit(0, 0);
+      builder.subject32(pid, 501, 20);
+      builder.return32(0, 0);
+      break;
+    default:
+      builder.begin(AUE_OPEN_R, i / 1000, i % 1000);
+      builder.arg32(2, 0, "flags");
+      builder.path("/Applications/Xcode.app/Contents/Developer/Platforms/"
+                   "MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include/"
+                   "stdio.h");
+      builder.text("/usr/include/stdio.h");
+      builder.subject32(pid, 501, 20);
+      builder.return32(0, 3);
+      break;
+    }
+    auto record = builder.finish();
+    trail.insert(trail.end(), record.data(), record.data() + record.size());
+  }
+  return trail;
+}
+
+static pid_t multimapScan(const knox::Record &record) {
+  static std::unordered_multimap<u_char, tokenstr_t> tokens;
+  tokens.clear();
+  for (auto &token : record) {
+    tokens.emplace(token.id, token);
+  }
+
+  pid_t pid = 0;
+  auto range = tokens.equal_range(AUT_SUBJECT32);
+  for (auto it = range.first; it != range.second; ++it) {
+    pid += it->second.tt.subj32.pid;
+  }
+  range = tokens.equal_range(AUT_EXEC_ARGS);
+  for (auto it = range.first; it != range.second; ++it) {
+    pid += it->second.tt.execarg.count;
+  }
+  return pid;
+}
+
+static pid_t switchScan(const knox::Record &record) {
+  pid_t pid = 0;
+  for (auto &token : record) {
+    switch (token.id) {
+    case AUT_SUBJECT32:
+      pid += token.tt.subj32.pid;
+      break;
+    case AUT_EXEC_ARGS:
+      pid += token.tt.execarg.count;
+      break;
+    }
+  }
+  return pid;
+}
+
+struct ScanHandler {
+  pid_t pid = 0;
+
+  bool operator()(knox::TokenTag<AUT_SUBJECT32>, const tokenstr_t &token) {
+    pid += token.tt.subj32.pid;
+    return true;
+  }
+
+  bool operator()(knox::TokenTag<AUT_EXEC_ARGS>, const tokenstr_t &token) {
+    pid += token.tt.execarg.count;
+    return true;
+  }
+};
+
+static pid_t scannerScan(const knox::Record &record) {
+  ScanHandler handler;
+  knox::TokenScanner<AUT_SUBJECT32, AUT_EXEC_ARGS>::scan(record, handler);
+  return handler.pid;
+}
+
+static pid_t recordFilter(const knox::Record &record) {
+  au_execarg_t args;
+  return knox::ExecEvent{record}.args(args) ? args.count : 0;
+}
+
+static pid_t batchFilter(const knox::RecordBatch &batch) {
+  static knox::Selection selection;
+  selection.reset(batch.size());
+  selection.filter(batch.events, knox::isExecEvent);
+
+  pid_t count = 0;
+  selection.forEach([&](size_t i) {
+    auto record = batch.record(i);
+    au_execarg_t args;
+    if (knox::ExecEvent{record}.args(args)) {
+      count += args.count;
+    }
+  });
+  return count;
+}
+
+// The columns of a record, decoded token by token, to check a batch.
+struct RecordColumns {
+  bool has_subject = false;
+  pid_t pid = 0;
+  uid_t uid = 0;
+  u_char status = 0;
+  u_int64_t value = 0;
+
+  template <u_char Id>
+  bool operator()(knox::TokenTag<Id> tag, const tokenstr_t &token) {
+    if (not has_subject) {
+      pid = knox::tokenPid(tag, token);
+      uid = tokenUid(tag, token);
+      has_subject = true;
+    }
+    return true;
+  }
+
+  bool operator()(knox::TokenTag<AUT_RETURN32>, const tokenstr_t &token) {
+    status = token.tt.ret32.status;
+    value = token.tt.ret32.ret;
+    return true;
+  }
+
+  bool operator()(knox::TokenTag<AUT_RETURN64>, const tokenstr_t &token) {
+    status = token.tt.ret64.err;
+    value = token.tt.ret64.val;
+    return true;
+  }
+
+  static uid_t tokenUid(knox::TokenTag<AUT_SUBJECT32>, const tokenstr_t &t) {
+    return t.tt.subj32.euid;
+  }
+  static uid_t tokenUid(knox::TokenTag<AUT_SUBJECT32_EX>, const tokenstr_t &t) {
+    return t.tt.subj32_ex.euid;
+  }
+  static uid_t tokenUid(knox::TokenTag<AUT_SUBJECT64>, const tokenstr_t &t) {
+    return t.tt.subj64.euid;
+  }
+  static uid_t tokenUid(knox::TokenTag<AUT_SUBJECT64_EX>, const tokenstr_t &t) {
+    return t.tt.subj64_ex.euid;
+  }
+};
+
+using ColumnScanner =
+    knox::TokenScanner<AUT_SUBJECT32, AUT_SUBJECT32_EX, AUT_SUBJECT64,
+                       AUT_SUBJECT64_EX, AUT_RETURN32, AUT_RETURN64>;
+
+// Whether the token at `offset` of the record is the first of type `id`, or
+// `offset` is 0 and the record has none.
+static bool checkOffset(const knox::Record &record, u_int32_t offset,
+                        u_char id) {
+  tokenstr_t token;
+  if (not record.find(id, token)) {
+    return offset == 0;
+  }
+  return offset > 0 && offset < record.size() && record.data()[offset] == id;
+}
+
+// Checks every column of the batch, decoded for all records, against the
+// records decoded token by token. Prints the first mismatch.
+static bool checkBatch(knox::RecordBatch &batch) {
+  knox::Selection selection;
+  selection.reset(batch.size());
+  batch.decodeTokens(selection);
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    auto record = batch.record(i);
+    RecordColumns columns;
+    ColumnScanner::scan(record, columns);
+    u_int64_t seconds = 0, milliseconds = 0;
+    record.time(seconds, milliseconds);
+
+    const char *column = nullptr;
+    if (batch.events[i] != record.event()) {
+      column = "events";
+    } else if (batch.times[i] != seconds * 1000 + milliseconds) {
+      column = "times";
+    } else if (batch.pids[i] != columns.pid) {
+      column = "pids";
+    } else if (batch.uids[i] != columns.uid) {
+      column = "uids";
+    } else if (batch.statuses[i] != columns.status) {
+      column = "statuses";
+    } else if (batch.returns[i] != columns.value) {
+      column = "returns";
+    } else if (not checkOffset(record, batch.paths[i], AUT_PATH)) {
+      column = "paths";
+    } else if (not checkOffset(record, batch.args[i], AUT_EXEC_ARGS)) {
+      column = "args";
+    }
+    if (column) {
+      fprintf(stderr, "error: batch column %s differs for record %zu\n",
+              column, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void report(const char *name, std::chrono::steady_clock::duration time,
+                   size_t records_count, pid_t checksum) {
+  const auto elapsed = std::chrono::duration<double, std::nano>(time).count();
+  printf("%-10s %8.1f ns/record  (checksum %d)\n", name,
+         elapsed / records_count, checksum);
+}
+
+template <typename Scan>
+static void measure(const char *name, const std::vector<u_char> &trail,
+                    Scan scan) {
+  using clock = std::chrono::steady_clock;
+  const int rounds = 10;
+
+  size_t records_count = 0;
+  pid_t checksum = 0;
+  const auto start = clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    size_t offset = 0;
+    while (offset < trail.size()) {
+      auto size =
+          knox::recordSize(trail.data() + offset, trail.size() - offset);
+      if (size <= 0 || offset + size > trail.size()) {
+        break;
+      }
+      knox::Record record{trail.data() + offset, (size_t)size};
+      checksum += scan(record);
+      offset += size;
+      ++records_count;
+    }
+  }
+  report(name, clock::now() - start, records_count, checksum);
+}
+
+// Calls `f(batch)` for batches of 1024 records of the trail, like a Reader's
+// batches of a 64KB read.
+template <typename F>
+static void forEachBatch(const std::vector<u_char> &trail,
+                         knox::RecordBatch &batch, F &&f) {
+  size_t offset = 0;
+  while (offset < trail.size()) {
+    auto size = knox::recordSize(trail.data() + offset, trail.size() - offset);
+    if (size <= 0 || offset + size > trail.size()) {
+      break;
+    }
+    batch.add(knox::Record{trail.data() + offset, (size_t)size});
+    offset += size;
+    if (batch.size() == 1024) {
+      f(batch);
+      batch.clear();
+    }
+  }
+  f(batch);
+  batch.clear();
+}
+
+static bool checkBatches(const std::vector<u_char> &trail) {
+  knox::RecordBatch batch;
+  bool ok = true;
+  forEachBatch(trail, batch, [&](knox::RecordBatch &batch) {
+    ok = ok && checkBatch(batch);
+  });
+  return ok;
+}
+
+// Like `measure`, with records in batches.
+template <typename Scan>
+static void measureBatch(const char *name, const std::vector<u_char> &trail,
+                         Scan scan) {
+  using clock = std::chrono::steady_clock;
+  const int rounds = 10;
+
+  size_t records_count = 0;
+  pid_t checksum = 0;
+  knox::RecordBatch batch;
+  const auto start = clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    forEachBatch(trail, batch, [&](knox::RecordBatch &batch) {
+      records_count += batch.size();
+      checksum += scan(batch);
+    });
+  }
+  report(name, clock::now() - start, records_count, checksum);
+}
+
+int main(int argc, char **argv) {
+  std::vector<u_char> trail;
+  if (argc > 1) {
+    auto input = fopen(argv[1], "r");
+    if (not input) {
+      perror("error");
+      return EXIT_FAILURE;
+    }
+    u_char buffer[1 << 16];
+    size_t read_size;
+    while ((read_size = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+      trail.insert(trail.end(), buffer, buffer + read_size);
+    }
+    fclose(input);
+  } else {
+    trail = synthesize(200000);
+  }
+
+  if (not checkBatches(trail)) {
+    return EXIT_FAILURE;
+  }
+
+  measure("multimap", trail, multimapScan);
+  measure("switch", trail, switchScan);
+  measure("scanner", trail, scannerScan);
+  printf("\n");
+  measure("record", trail, recordFilter);
+  measureBatch("batch", trail, batchFilter);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+#include "knox/auditpipe.h"
+#include "knox/batch.h"
+#include "knox/builder.h"
+#include "knox/classes.h"
+#include "knox/events.h"
+#include "knox/processes.h"
+#include "knox/rates.h"
+#include "knox/sampler.h"
+#include "knox/stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+
+// The command a process runs, truncated like the detector's names, so that
+// process entries are a fixed size.
+struct ProcessCommand {
+  u_char size;
+  char name[31];
+
+  knox::StringRef ref() const { return {name, size}; }
+};
+
+static ProcessCommand processCommand(knox::StringRef command) {
+  ProcessCommand process;
+  process.size = std::min(command.size, sizeof(process.name));
+  memcpy(process.name, command.data, process.size);
+  return process;
+}
+
+static bool isRateEvent(au_event_t event) {
+  return knox::isExecEvent(event) || event == AUE_FORK ||
+         event == AUE_VFORK || event == AUE_EXIT;
+}
+
+// Live, preselects only the events counted, mapped to a class of their own
+// like `auditon profile`, rather than all of `pc`, or adding them to a system
+// class, which other readers would see. The caller undoes the mapping, with
+// `unprofileEvents(profile)`.
+static int openRateAuditpipe(au_class_t &profile) {
+  profile = knox::profileEvents(
+      {"AUE_EXECVE", "AUE_POSIX_SPAWN", "AUE_FORK", "AUE_VFORK", "AUE_EXIT"});
+  if (profile == 0) {
+    return -1;
+  }
+
+  au_mask_t masks{};
+  masks.am_success = profile;
+  auto pipe = knox::openAuditpipe(masks);
+  if (pipe == -1) {
+    auto error = errno;
+    knox::unprofileEvents(profile);
+    profile = 0;
+    errno = error;
+  }
+  return pipe;
+}
+
+// Undoes the live profile on every return.
+struct ProfileGuard {
+  const au_class_t &profile;
+
+  ~ProfileGuard() {
+    if (profile != 0 && not knox::unprofileEvents(profile)) {
+      fprintf(stderr, "warning: could not unprofile 0x%08x, try `auditon "
+                      "unprofile 0x%08x`\n",
+              profile, profile);
+    }
+  }
+};
+
+static auto usage() {
+  fprintf(stderr,
+          "usage: execrate [-x <multiple>] [-r <rate>] [-l <half-life>] "
+          "[-w <seconds>] [-n <commands>] [<audit-log>]\n"
+          "\n"
+          "  -x  alert past this multiple of a command's baseline (default "
+          "10)\n"
+          "  -r  and past this many execs and forks a second (default 10)\n"
+          "  -l  the baseline's half life, in seconds (default 300)\n"
+          "  -w  seconds a command is seen before its alerts (default 60)\n"
+          "  -n  the most commands tracked at once (default 4096)\n");
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+  knox::stats::init(argc, argv);
+
+  double multiple = 10;
+  double minimum_rate = 10;
+  double half_life = 300;
+  u_int64_t warmup = 60;
+  size_t capacity = 1 << 12;
+
+  int option;
+  while ((option = getopt(argc, argv, "x:r:l:w:n:h")) != -1) {
+    switch (option) {
+    case 'x':
+      multiple = strtod(optarg, nullptr);
+      break;
+    case 'r':
+      minimum_rate = strtod(optarg, nullptr);
+      break;
+    case 'l':
+      half_life = strtod(optarg, nullptr);
+      break;
+    case 'w':
+      warmup = strtoull(optarg, nullptr, 10);
+      break;
+    case 'n':
+      capacity = strtoul(optarg, nullptr, 10);
+      if (capacity == 0) {
+        return usage();
+      }
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  if (argc - optind > 1 || multiple <= 0 || half_life <= 0) {
+    return usage();
+  }
+
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "error: cannot print to stdout, try piping to praudit\n");
+    return EXIT_FAILURE;
+  }
+
+  // With no audit log, read from stdin when it's piped, otherwise live events.
+  const bool read_log = optind < argc;
+  const bool read_stdin = not read_log && not isatty(STDIN_FILENO);
+
+  if (geteuid() != 0 && not read_log && not read_stdin) {
+    fprintf(stderr, "Re-running as root\n");
+    const char *cmd[argc + 3];
+    cmd[0] = "sudo";
+    for (int i = 0; i < argc; ++i) {
+      cmd[i + 1] = argv[i];
+    }
+    cmd[argc + 1] = knox::stats::enabled() ? "--stats" : nullptr;
+    cmd[argc + 2] = nullptr;
+    execvp("sudo", (char **)cmd);
+  }
+
+  if (not read_log && not read_stdin) {
+    // Live, stop on SIGINT, or a closed stdout, rather than terminate, so
+    // that the profile is undone.
+    knox::stopOnInterrupt();
+    signal(SIGPIPE, SIG_IGN);
+  }
+
+  au_class_t profile = 0;
+  ProfileGuard profile_guard{profile};
+  knox::Reader input =
+      read_log     ? knox::Reader::open(argv[optind])
+      : read_stdin ? knox::Reader{STDIN_FILENO, false}
+                   : knox::Reader{openRateAuditpipe(profile)};
+  if (input.error()) {
+    perror("error");
+    return EXIT_FAILURE;
+  }
+
+  // Forks are counted as the command of the parent, so the command of each
+  // process is kept, from its exec, or inherited on fork. Entries are erased
+  // on exit.
+  knox::ProcessCache<ProcessCommand> processes{1 << 16};
+  if (not read_log && not read_stdin) {
+    // Live, know the existing processes up front, so that their forks are
+    // counted too.
+    std::vector<knox::ProcessInfo> table;
+    if (knox::listProcesses(table)) {
+      for (auto &process : table) {
+        knox::StringRef command{process.command.data(),
+                                process.command.size()};
+        processes.insert(process.pid, process.start_time,
+                         processCommand(command));
+      }
+    } else {
+      perror("warning: could not list processes");
+    }
+  }
+
+  // Unlike the other tools, there's no KNOX_SAMPLE, because rates of sampled
+  // events are not the rates of the command.
+  knox::RateDetector detector{capacity, multiple, minimum_rate, half_life,
+                              warmup};
+  knox::RecordBuilder builder;
+  knox::RecordBatch batch;
+  knox::Selection selection;
+  u_int64_t events_count = 0;
+  u_int64_t alerts_count = 0;
+  bool written = true;
+  while (written && not knox::interrupted() && input.next(batch)) {
+    selection.reset(batch.size());
+    {
+      knox::stats::Timer timer{knox::stats::Match};
+      selection.filter(batch.events, isRateEvent);
+      batch.decodeTokens(selection);
+    }
+
+    selection.forEach([&](size_t i) {
+      if (not written) {
+        return;
+      }
+
+      knox::stats::Timer match_timer{knox::stats::Match};
+      auto record = batch.record(i);
+      const auto event = batch.events[i];
+      const auto time = batch.times[i];
+      const auto pid = batch.pids[i];
+
+      if (event == AUE_EXIT) {
+        processes.erase(pid);
+        return;
+      }
+
+      knox::StringRef command;
+      if (knox::isExecEvent(event)) {
+        // An exec, or a posix_spawn, of which the subject is the parent.
+        command = knox::ExecEvent{record}.command();
+        auto child_pid = knox::ProcessEvent{record}.childPid();
+        processes.insert(child_pid != 0 ? child_pid : pid, time,
+                         processCommand(command));
+      } else if (auto parent = processes.find(pid)) {
+        // A fork, the child runs the same command as its parent. Forks of
+        // unknown processes are not counted.
+        auto child_pid = knox::ProcessEvent{record}.childPid();
+        if (child_pid != 0) {
+          parent = &processes.insert(child_pid, time, parent->state);
+        }
+        command = parent->state.ref();
+      }
+
+      if (command.empty()) {
+        return;
+      }
+      ++events_count;
+
+      knox::RateDetector::Alert alert;
+      if (not detector.add(command, time, alert)) {
+        return;
+      }
+      ++alerts_count;
+
+      char text[128];
+      snprintf(text, sizeof(text),
+               "exec rate of %.*s: %u/s, baseline %.1f/s (sd %.1f)",
+               (int)alert.command.size, alert.command.data, alert.rate,
+               alert.baseline, alert.deviation);
+      // Not of the triggering event, an exec or fork, which views downstream
+      // would take the alert for.
+      builder.begin(knox::AUE_KNOX_ALERT, time / 1000, time % 1000);
+      builder.subject32(pid, batch.uids[i]);
+      builder.text(text);
+      builder.return32(0, 0);
+      auto alert_record = builder.finish();
+
+      knox::stats::Timer timer{knox::stats::Output};
+      auto write_size =
+          write(STDOUT_FILENO, alert_record.data(), alert_record.size());
+      written = write_size == (ssize_t)alert_record.size();
+    });
+  }
+
+  if (not written) {
+    perror("error: failed to write to stdout");
+    return EXIT_FAILURE;
+  }
+
+  if (input.error() && not knox::interrupted()) {
+    errno = input.error();
+    perror("error");
+    return EXIT_FAILURE;
+  }
+
+  if (detector.evictions() > 0) {
+    fprintf(stderr, "warning: evicted %llu commands, consider a larger -n\n",
+            (unsigned long long)detector.evictions());
+  }
+  fprintf(stderr, "execrate: %llu execs and forks of %zu commands, %llu "
+                  "alerts\n",
+          (unsigned long long)events_count, detector.size(),
+          (unsigned long long)alerts_count);
+
+  return EXIT_SUCCESS;
+}
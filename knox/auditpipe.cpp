@@ -0,0 +1,140 @@
+#include "auditpipe.h"
+#include "classes.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <security/audit/audit_ioctl.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace knox {
+
+#if defined(__APPLE__)
+
+bool configureAuditpipe(int pipe, const au_mask_t &masks) {
+  int mode = AUDITPIPE_PRESELECT_MODE_LOCAL;
+  u_int max_qlimit;
+  auto preselect_masks = masks;
+  return ioctl(pipe, AUDITPIPE_SET_PRESELECT_MODE, &mode) == 0 &&
+         ioctl(pipe, AUDITPIPE_GET_QLIMIT_MAX, &max_qlimit) == 0 &&
+         ioctl(pipe, AUDITPIPE_SET_QLIMIT, &max_qlimit) == 0 &&
+         ioctl(pipe, AUDITPIPE_SET_PRESELECT_FLAGS, &preselect_masks) == 0;
+}
+
+int openAuditpipe(const au_mask_t &masks) {
+  auto pipe = open("/dev/auditpipe", O_RDONLY);
+  if (pipe == -1) {
+    return -1;
+  }
+
+  if (not configureAuditpipe(pipe, masks)) {
+    auto error = errno;
+    close(pipe);
+    errno = error;
+    return -1;
+  }
+
+  return pipe;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+static bool updateEventClass(const char *event_name, const char *class_name,
+                             bool add) {
+  auto event_num = getauevnonam(event_name);
+  if (not event_num) {
+    return false;
+  }
+
+  au_evclass_map_t evc_map{};
+  evc_map.ec_number = *event_num;
+  if (audit_get_class(&evc_map, sizeof(evc_map))) {
+    return false;
+  }
+
+  auto class_ent = getauclassnam(class_name);
+  if (not class_ent) {
+    return false;
+  }
+
+  auto current_mask = evc_map.ec_class;
+  if (add) {
+    evc_map.ec_class |= class_ent->ac_class;
+  } else {
+    evc_map.ec_class &= ~class_ent->ac_class;
+  }
+
+  if (evc_map.ec_class == current_mask) {
+    return true;
+  }
+  return audit_set_class(&evc_map, sizeof(evc_map)) == 0;
+}
+#pragma clang diagnostic pop
+
+bool addEventClass(const char *event_name, const char *class_name) {
+  return updateEventClass(event_name, class_name, true);
+}
+
+bool removeEventClass(const char *event_name, const char *class_name) {
+  return updateEventClass(event_name, class_name, false);
+}
+
+int openExecAuditpipe() {
+  //
+  // Setup the `ex` event class. This is a hypothetical optimization.
+  //
+  // By default, the `pc` class includes the two events we want, `execve` and
+  // `posix_spawn`, while the `ex` event class includes only `execve`. However,
+  // the `pc` event class includes many other event's we're not interested in,
+  // while the `ex` event class has very few events.
+  if (not addEventClass("AUE_POSIX_SPAWN", "ex")) {
+    return -1;
+  }
+
+  return openAuditpipe("+ex");
+}
+
+#else
+
+// OpenBSM elsewhere reads and writes audit logs, but there's no auditpipe.
+
+bool configureAuditpipe(int pipe, const au_mask_t &masks) {
+  errno = ENOTSUP;
+  return false;
+}
+
+int openAuditpipe(const au_mask_t &masks) {
+  errno = ENOTSUP;
+  return -1;
+}
+
+int openExecAuditpipe() {
+  errno = ENOTSUP;
+  return -1;
+}
+
+bool addEventClass(const char *event_name, const char *class_name) {
+  errno = ENOTSUP;
+  return false;
+}
+
+bool removeEventClass(const char *event_name, const char *class_name) {
+  errno = ENOTSUP;
+  return false;
+}
+
+#endif
+
+int openAuditpipe(const char *event_classes) {
+  au_mask_t masks;
+  if (not parseEventClasses(event_classes, masks)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return openAuditpipe(masks);
+}
+
+} // namespace knox
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <bsm/libbsm.h>
+
+namespace knox {
+
+// Opens /dev/auditpipe, configured to preselect the given event classes, and
+// with its event queue increased to the largest maximum size. Returns -1 on
+// failure, with errno set. See man auditpipe for details.
+int openAuditpipe(const au_mask_t &masks);
+int openAuditpipe(const char *event_classes);
+
+// Configures an open /dev/auditpipe, like `openAuditpipe`. Returns false on
+// failure, with errno set.
+bool configureAuditpipe(int pipe, const au_mask_t &masks);
+
+// Opens /dev/auditpipe for successful `execve` and `posix_spawn` events.
+int openExecAuditpipe();
+
+// Adds (or removes) an event to (or from) an event class, in the kernel's
+// event to class mapping. Returns false on failure.
+bool addEventClass(const char *event_name, const char *class_name);
+bool removeEventClass(const char *event_name, const char *class_name);
+
+} // namespace knox
@@ -0,0 +1,101 @@
+#include "batch.h"
+#include "stats.h"
+#include "tokens.h"
+
+namespace knox {
+
+static u_int32_t read32(const u_char *data) {
+  return (u_int32_t)data[0] << 24 | (u_int32_t)data[1] << 16 |
+         (u_int32_t)data[2] << 8 | data[3];
+}
+
+static u_int64_t read64(const u_char *data) {
+  return (u_int64_t)read32(data) << 32 | read32(data + 4);
+}
+
+void RecordBatch::clear() {
+  data.clear();
+  sizes.clear();
+  events.clear();
+  times.clear();
+  // The token columns keep their size, so that they're not zeroed for every
+  // batch, only the decoded records are.
+}
+
+void RecordBatch::add(const Record &record) {
+  u_int64_t seconds = 0, milliseconds = 0;
+  record.time(seconds, milliseconds);
+
+  data.push_back(record.data());
+  sizes.push_back(record.size());
+  events.push_back(record.event());
+  times.push_back(seconds * 1000 + milliseconds);
+}
+
+void RecordBatch::decodeTokens(const Selection &selection) {
+  stats::Timer timer{stats::Decode};
+  const auto count = size();
+  if (pids.size() < count) {
+    pids.resize(count);
+    uids.resize(count);
+    statuses.resize(count);
+    returns.resize(count);
+    paths.resize(count);
+    args.resize(count);
+  }
+
+  selection.forEach([&](size_t i) {
+    pids[i] = 0;
+    uids[i] = 0;
+    statuses[i] = 0;
+    returns[i] = 0;
+    paths[i] = 0;
+    args[i] = 0;
+
+    const auto start = data[i];
+    const size_t size = sizes[i];
+    bool has_subject = false;
+    size_t offset = 0;
+    while (offset < size) {
+      auto token = start + offset;
+      auto token_size = tokenSize(token, size - offset);
+      if (token_size == 0) {
+        break;
+      }
+      stats::count(stats::Tokens);
+
+      switch (*token) {
+      case AUT_SUBJECT32:
+      case AUT_SUBJECT32_EX:
+      case AUT_SUBJECT64:
+      case AUT_SUBJECT64_EX:
+        // All variants start with auid, euid, egid, ruid, rgid, and pid.
+        if (not has_subject && token_size >= 29) {
+          uids[i] = read32(token + 5);
+          pids[i] = read32(token + 21);
+          has_subject = true;
+        }
+        break;
+      case AUT_RETURN32:
+        statuses[i] = token[1];
+        returns[i] = read32(token + 2);
+        break;
+      case AUT_RETURN64:
+        statuses[i] = token[1];
+        returns[i] = read64(token + 2);
+        break;
+      case AUT_PATH:
+        if (paths[i] == 0) {
+          paths[i] = offset;
+        }
+        break;
+      case AUT_EXEC_ARGS:
+        args[i] = offset;
+        break;
+      }
+      offset += token_size;
+    }
+  });
+}
+
+} // namespace knox
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "record.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace knox {
+
+class Selection;
+
+// A batch of records, decoded into columns, so that filters and aggregations
+// are tight loops over arrays, rather than token by token per record. Records
+// are views into the `Reader` buffer, valid until the reader's next call.
+//
+// Columns are decoded in two steps. The header columns are decoded for every
+// record, cheaply, from the header. The token columns, which need a pass over
+// each record's tokens, are decoded by `decodeTokens`, only for the records
+// selected by the header filters. For example, to select the failed execs of
+// a user:
+//
+//     selection.reset(batch.size());
+//     selection.filter(batch.events, isExecEvent);
+//     batch.decodeTokens(selection);
+//     selection.filter(batch.uids, [&](uid_t u) { return u == uid; });
+//     selection.filter(batch.statuses, [](u_char s) { return s != 0; });
+//     selection.forEach([&](size_t i) { auto record = batch.record(i); });
+struct RecordBatch {
+  // Header columns.
+  std::vector<const u_char *> data;
+  std::vector<u_int32_t> sizes;
+  std::vector<au_event_t> events;
+  // Milliseconds since the epoch, or 0 if the record has no header.
+  std::vector<u_int64_t> times;
+
+  // Token columns, 0 for records that have no such token, and undefined for
+  // records that were not decoded, which filters don't look at, because
+  // they aren't selected. The pid and uid (effective) are of the first
+  // subject token.
+  std::vector<pid_t> pids;
+  std::vector<uid_t> uids;
+  std::vector<u_char> statuses;
+  std::vector<u_int64_t> returns;
+  // Offsets, from the start of the record, of the first path token and of
+  // the exec args token.
+  std::vector<u_int32_t> paths;
+  std::vector<u_int32_t> args;
+
+  size_t size() const { return data.size(); }
+  bool empty() const { return data.empty(); }
+
+  void clear();
+
+  // Appends the header columns of a record, which must outlive the batch.
+  void add(const Record &record);
+
+  // Decodes the token columns of the selected records.
+  void decodeTokens(const Selection &selection);
+
+  // The record at index `i`.
+  Record record(size_t i) const { return {data[i], sizes[i]}; }
+};
+
+// A bitmap of the records of a batch, to be narrowed down by filters.
+class Selection {
+public:
+  // Selects all of `count` records.
+  void reset(size_t count) {
+    _count = count;
+    _words.assign((count + 63) / 64, ~0ull);
+    if (count % 64) {
+      _words.back() = (1ull << (count % 64)) - 1;
+    }
+  }
+
+  // Deselects the records for which `predicate(column[i])` is false. The
+  // loop is branchless, so that compilers can vectorize simple predicates.
+  template <typename T, typename Predicate>
+  void filter(const std::vector<T> &column, Predicate &&predicate) {
+    for (size_t word = 0; word < _words.size(); ++word) {
+      if (_words[word] == 0) {
+        continue;
+      }
+      const auto base = word * 64;
+      const auto count = std::min<size_t>(64, _count - base);
+      const T *values = column.data() + base;
+      u_int64_t bits = 0;
+      for (size_t i = 0; i < count; ++i) {
+        bits |= (u_int64_t)(bool)predicate(values[i]) << i;
+      }
+      _words[word] &= bits;
+    }
+  }
+
+  bool test(size_t i) const { return _words[i / 64] >> (i % 64) & 1; }
+
+  size_t count() const {
+    size_t count = 0;
+    for (auto word : _words) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+
+  // Calls `f(i)` for each selected record, in order.
+  template <typename F> void forEach(F &&f) const {
+    for (size_t word = 0; word < _words.size(); ++word) {
+      auto bits = _words[word];
+      while (bits) {
+        f(word * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+private:
+  std::vector<u_int64_t> _words;
+  size_t _count = 0;
+};
+
+} // namespace knox
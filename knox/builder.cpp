@@ -0,0 +1,121 @@
+#include "builder.h"
+
+namespace knox {
+
+void RecordBuilder::put16(u_int16_t value) {
+  put8(value >> 8);
+  put8(value);
+}
+
+void RecordBuilder::put32(u_int32_t value) {
+  put16(value >> 16);
+  put16(value);
+}
+
+void RecordBuilder::putString(const char *string, bool with_length) {
+  // Lengths and strings include the trailing NUL.
+  auto length = strlen(string) + 1;
+  if (with_length) {
+    put16(length);
+  }
+  _buffer.insert(_buffer.end(), string, string + length);
+}
+
+void RecordBuilder::begin(au_event_t event, u_int32_t seconds,
+                          u_int32_t milliseconds, u_int16_t modifier) {
+  _buffer.clear();
+  put8(AUT_HEADER32);
+  // The record size is filled in by `finish`.
+  put32(0);
+  put8(AUDIT_HEADER_VERSION_OPENBSM);
+  put16(event);
+  put16(modifier);
+  put32(seconds);
+  put32(milliseconds);
+}
+
+void RecordBuilder::begin(const Record &record) {
+  auto size = record.size();
+  if (size >= 7) {
+    auto trailer = record.data() + size - 7;
+    if (trailer[0] == AUT_TRAILER &&
+        (trailer[1] << 8 | trailer[2]) == AUT_TRAILER_MAGIC) {
+      size -= 7;
+    }
+  }
+  _buffer.assign(record.data(), record.data() + size);
+}
+
+void RecordBuilder::process(u_char id, pid_t pid, uid_t uid, gid_t gid,
+                            au_asid_t sid) {
+  put8(id);
+  // auid, euid, egid, ruid, rgid, pid, sid, terminal port and address.
+  put32(uid);
+  put32(uid);
+  put32(gid);
+  put32(uid);
+  put32(gid);
+  put32(pid);
+  put32(sid);
+  put32(0);
+  put32(0);
+}
+
+void RecordBuilder::subject32(pid_t pid, uid_t uid, gid_t gid, au_asid_t sid) {
+  process(AUT_SUBJECT32, pid, uid, gid, sid);
+}
+
+void RecordBuilder::process32(pid_t pid, uid_t uid, gid_t gid, au_asid_t sid) {
+  process(AUT_PROCESS32, pid, uid, gid, sid);
+}
+
+void RecordBuilder::arg32(u_char number, u_int32_t value, const char *text) {
+  put8(AUT_ARG32);
+  put8(number);
+  put32(value);
+  putString(text, true);
+}
+
+void RecordBuilder::execArgs(const char *const *args, u_int32_t count) {
+  put8(AUT_EXEC_ARGS);
+  put32(count);
+  for (u_int32_t i = 0; i < count; ++i) {
+    putString(args[i], false);
+  }
+}
+
+void RecordBuilder::path(const char *path) {
+  put8(AUT_PATH);
+  putString(path, true);
+}
+
+void RecordBuilder::text(const char *text) {
+  put8(AUT_TEXT);
+  putString(text, true);
+}
+
+void RecordBuilder::return32(u_char status, u_int32_t value) {
+  put8(AUT_RETURN32);
+  put8(status);
+  put32(value);
+}
+
+void RecordBuilder::exit(u_int32_t status, u_int32_t value) {
+  put8(AUT_EXIT);
+  put32(status);
+  put32(value);
+}
+
+Record RecordBuilder::finish() {
+  const u_int32_t size = _buffer.size() + 7;
+  put8(AUT_TRAILER);
+  put16(AUT_TRAILER_MAGIC);
+  put32(size);
+
+  for (int i = 0; i < 4; ++i) {
+    _buffer[1 + i] = size >> (24 - 8 * i);
+  }
+  return {_buffer.data(), _buffer.size()};
+}
+
+} // namespace knox
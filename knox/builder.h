@@ -0,0 +1,43 @@
+#pragma once
+
+#include "record.h"
+
+namespace knox {
+
+// Builds audit records in the BSM format, for synthetic trails and for
+// records emitted by knox tools. A builder reuses its buffer, so once warmed
+// up building a record does not allocate.
+class RecordBuilder {
+public:
+  // Starts a record with a 32 bit header token.
+  void begin(au_event_t event, u_int32_t seconds, u_int32_t milliseconds,
+             u_int16_t modifier = 0);
+
+  // Starts a record with the tokens of an existing record, except for its
+  // trailer, so that tokens can be appended to it.
+  void begin(const Record &record);
+
+  void subject32(pid_t pid, uid_t uid = 0, gid_t gid = 0, au_asid_t sid = 0);
+  void process32(pid_t pid, uid_t uid = 0, gid_t gid = 0, au_asid_t sid = 0);
+  void arg32(u_char number, u_int32_t value, const char *text);
+  void execArgs(const char *const *args, u_int32_t count);
+  void path(const char *path);
+  void text(const char *text);
+  void return32(u_char status, u_int32_t value);
+  void exit(u_int32_t status, u_int32_t value);
+
+  // Appends the trailer token and fills in the record size. The record is
+  // valid until the next call to `begin`.
+  Record finish();
+
+private:
+  void put8(u_char value) { _buffer.push_back(value); }
+  void put16(u_int16_t value);
+  void put32(u_int32_t value);
+  void putString(const char *string, bool with_length);
+  void process(u_char id, pid_t pid, uid_t uid, gid_t gid, au_asid_t sid);
+
+  std::vector<u_char> _buffer;
+};
+
+} // namespace knox
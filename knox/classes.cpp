@@ -0,0 +1,318 @@
+#include "classes.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace knox {
+
+// Reads lines, skipping blank lines and comments, and splits them by ':'.
+template <typename F> static bool forEachEntry(FILE *file, F &&f) {
+  char *line = nullptr;
+  size_t capacity = 0;
+  bool ok = true;
+  while (ok && getline(&line, &capacity, file) != -1) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+
+    std::vector<std::string> fields;
+    char *cursor = line;
+    char *separator;
+    while ((separator = strchr(cursor, ':')) != nullptr) {
+      fields.emplace_back(cursor, separator - cursor);
+      cursor = separator + 1;
+    }
+    fields.emplace_back(cursor);
+    ok = f(fields);
+  }
+  free(line);
+  return ok;
+}
+
+bool parseAuditClasses(FILE *file, std::vector<AuditClass> &classes) {
+  // <mask>:<name>:<description>
+  return forEachEntry(file, [&](const std::vector<std::string> &fields) {
+    if (fields.size() < 2) {
+      return false;
+    }
+    char *end;
+    auto mask = strtoul(fields[0].c_str(), &end, 0);
+    if (*end != '\0') {
+      return false;
+    }
+    classes.push_back({(au_class_t)mask, fields[1]});
+    return true;
+  });
+}
+
+// The mask of comma separated class names. Unknown names are skipped, with a
+// warning, rather than failing the whole file.
+static au_class_t classesMask(const std::vector<AuditClass> &classes,
+                              const std::string &names,
+                              const std::string &event_name) {
+  au_class_t mask = 0;
+  size_t start = 0;
+  while (start <= names.size()) {
+    auto end = names.find(',', start);
+    if (end == std::string::npos) {
+      end = names.size();
+    }
+
+    auto name = names.substr(start, end - start);
+    if (not name.empty()) {
+      bool found = false;
+      for (auto &audit_class : classes) {
+        if (audit_class.name == name) {
+          mask |= audit_class.mask;
+          found = true;
+          break;
+        }
+      }
+      if (not found) {
+        fprintf(stderr, "warning: unknown audit class %s of %s\n",
+                name.c_str(), event_name.c_str());
+      }
+    }
+    start = end + 1;
+  }
+  return mask;
+}
+
+bool parseAuditEvents(FILE *file, const std::vector<AuditClass> &classes,
+                      std::vector<AuditEvent> &events) {
+  // <number>:<name>:<description>:<classes>
+  return forEachEntry(file, [&](const std::vector<std::string> &fields) {
+    if (fields.size() < 4) {
+      return false;
+    }
+    char *end;
+    auto number = strtoul(fields[0].c_str(), &end, 10);
+    if (*end != '\0') {
+      return false;
+    }
+    auto mask = classesMask(classes, fields.back(), fields[1]);
+    events.push_back({(au_event_t)number, fields[1], mask});
+    return true;
+  });
+}
+
+bool loadAuditEvents(std::vector<AuditClass> &classes,
+                     std::vector<AuditEvent> &events) {
+  auto class_file = fopen(AUDIT_CLASS_FILE, "r");
+  if (not class_file) {
+    return false;
+  }
+  auto parsed = parseAuditClasses(class_file, classes);
+  fclose(class_file);
+
+  auto event_file = fopen(AUDIT_EVENT_FILE, "r");
+  if (not event_file) {
+    return false;
+  }
+  parsed = parsed && parseAuditEvents(event_file, classes, events);
+  fclose(event_file);
+  if (not parsed) {
+    errno = EINVAL;
+    return false;
+  }
+
+  for (auto &event : events) {
+    au_evclass_map_t evc_map{};
+    evc_map.ec_number = event.number;
+    if (audit_get_class(&evc_map, sizeof(evc_map)) == 0) {
+      event.mask = evc_map.ec_class;
+    }
+  }
+  return true;
+}
+
+const AuditEvent *findAuditEvent(const std::vector<AuditEvent> &events,
+                                 const std::string &name) {
+  for (auto &event : events) {
+    if (event.name == name) {
+      return &event;
+    }
+  }
+  return nullptr;
+}
+
+const AuditClass *findAuditClass(const std::vector<AuditClass> &classes,
+                                 au_class_t mask) {
+  for (auto &audit_class : classes) {
+    if (audit_class.mask == mask) {
+      return &audit_class;
+    }
+  }
+  return nullptr;
+}
+
+au_class_t unusedClassBit(const std::vector<AuditClass> &classes,
+                          const std::vector<AuditEvent> &events) {
+  au_class_t used = 0;
+  for (auto &audit_class : classes) {
+    // Only count singular masks, for example not the "all" mask.
+    if (__builtin_popcount(audit_class.mask) == 1) {
+      used |= audit_class.mask;
+    }
+  }
+  for (auto &event : events) {
+    used |= event.mask;
+  }
+
+  for (int bit = 0; bit < 32; ++bit) {
+    au_class_t mask = 1u << bit;
+    if ((used & mask) == 0) {
+      return mask;
+    }
+  }
+  return 0;
+}
+
+bool profileMappings(const std::vector<AuditEvent> &events,
+                     const std::vector<std::string> &names,
+                     au_class_t class_bit,
+                     std::vector<au_evclass_map_t> &mappings,
+                     std::string &unknown) {
+  mappings.clear();
+  for (auto &name : names) {
+    auto event = findAuditEvent(events, name);
+    if (not event) {
+      unknown = name;
+      return false;
+    }
+
+    au_evclass_map_t evc_map{};
+    evc_map.ec_number = event->number;
+    evc_map.ec_class = event->mask | class_bit;
+    mappings.push_back(evc_map);
+  }
+  return true;
+}
+
+std::vector<au_evclass_map_t>
+unprofileMappings(const std::vector<AuditEvent> &events, au_class_t class_bit) {
+  std::vector<au_evclass_map_t> mappings;
+  for (auto &event : events) {
+    if (event.mask & class_bit) {
+      au_evclass_map_t evc_map{};
+      evc_map.ec_number = event.number;
+      evc_map.ec_class = event.mask & ~class_bit;
+      mappings.push_back(evc_map);
+    }
+  }
+  return mappings;
+}
+
+bool setEventClasses(const std::vector<au_evclass_map_t> &mappings,
+                     size_t &applied) {
+  for (applied = 0; applied < mappings.size(); ++applied) {
+    auto evc_map = mappings[applied];
+    if (audit_set_class(&evc_map, sizeof(evc_map))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool applyProfile(std::vector<au_evclass_map_t> mappings,
+                  au_class_t class_bit) {
+  size_t applied;
+  if (setEventClasses(mappings, applied)) {
+    return true;
+  }
+
+  auto error = errno;
+  mappings.resize(applied);
+  for (auto &evc_map : mappings) {
+    evc_map.ec_class &= ~class_bit;
+  }
+  setEventClasses(mappings, applied);
+  errno = error;
+  return false;
+}
+
+au_class_t profileEvents(const std::vector<std::string> &names) {
+  std::vector<AuditClass> classes;
+  std::vector<AuditEvent> events;
+  if (not loadAuditEvents(classes, events)) {
+    return 0;
+  }
+
+  auto class_bit = unusedClassBit(classes, events);
+  if (class_bit == 0) {
+    errno = ENOSPC;
+    return 0;
+  }
+
+  std::vector<au_evclass_map_t> mappings;
+  std::string unknown;
+  if (not profileMappings(events, names, class_bit, mappings, unknown)) {
+    errno = ENOENT;
+    return 0;
+  }
+
+  return applyProfile(std::move(mappings), class_bit) ? class_bit : 0;
+}
+
+bool unprofileEvents(au_class_t class_bit) {
+  std::vector<AuditClass> classes;
+  std::vector<AuditEvent> events;
+  if (not loadAuditEvents(classes, events)) {
+    return false;
+  }
+
+  size_t applied;
+  return setEventClasses(unprofileMappings(events, class_bit), applied);
+}
+
+bool parseEventClasses(const char *event_classes, au_mask_t &masks) {
+  std::string names;
+  au_mask_t numeric{};
+
+  std::string classes{event_classes};
+  size_t start = 0;
+  while (start <= classes.size()) {
+    auto end = classes.find(',', start);
+    if (end == std::string::npos) {
+      end = classes.size();
+    }
+
+    auto item = classes.substr(start, end - start);
+    auto digits = item.c_str();
+    if (*digits == '+' || *digits == '-') {
+      ++digits;
+    }
+    if (strncmp(digits, "0x", 2) == 0) {
+      char *digits_end;
+      auto mask = (au_class_t)strtoul(digits, &digits_end, 16);
+      if (*digits_end != '\0') {
+        return false;
+      }
+      if (item[0] != '-') {
+        numeric.am_success |= mask;
+      }
+      if (item[0] != '+') {
+        numeric.am_failure |= mask;
+      }
+    } else if (not item.empty()) {
+      if (not names.empty()) {
+        names.push_back(',');
+      }
+      names.append(item);
+    }
+    start = end + 1;
+  }
+
+  masks = {};
+  if (not names.empty() && getauditflagsbin(&names[0], &masks)) {
+    return false;
+  }
+  masks.am_success |= numeric.am_success;
+  masks.am_failure |= numeric.am_failure;
+  return true;
+}
+
+} // namespace knox
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <bsm/libbsm.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace knox {
+
+// An entry of /etc/security/audit_class. See man audit_class.
+struct AuditClass {
+  au_class_t mask;
+  std::string name;
+};
+
+// An entry of /etc/security/audit_event, with the mask of its classes. See
+// man audit_event.
+struct AuditEvent {
+  au_event_t number;
+  std::string name;
+  au_class_t mask;
+};
+
+// Parsers for the audit_class and audit_event file formats. Unlike
+// getauclassent(3) and getauevent(3), these can read any file. Event classes
+// are resolved to masks using `classes`, unknown class names are skipped
+// with a warning. Return false on malformed input.
+bool parseAuditClasses(FILE *file, std::vector<AuditClass> &classes);
+bool parseAuditEvents(FILE *file, const std::vector<AuditClass> &classes,
+                      std::vector<AuditEvent> &events);
+
+// Reads the system's audit_class and audit_event files, with each event's
+// mask taken from the kernel's current event to class mapping, when it's
+// available (which requires root).
+bool loadAuditEvents(std::vector<AuditClass> &classes,
+                     std::vector<AuditEvent> &events);
+
+const AuditEvent *findAuditEvent(const std::vector<AuditEvent> &events,
+                                 const std::string &name);
+
+// The class of exactly the given mask, or null if it has no name.
+const AuditClass *findAuditClass(const std::vector<AuditClass> &classes,
+                                 au_class_t mask);
+
+// The lowest class bit that's neither defined as a class, nor mapped to any
+// event. Multi-bit classes, like "all", don't count. Returns 0 if every bit
+// is in use.
+au_class_t unusedClassBit(const std::vector<AuditClass> &classes,
+                          const std::vector<AuditEvent> &events);
+
+// The event to class mappings that add `class_bit` to exactly the named
+// events, given the events' current masks. Returns false if a name is not an
+// event, with the name in `unknown`.
+bool profileMappings(const std::vector<AuditEvent> &events,
+                     const std::vector<std::string> &names,
+                     au_class_t class_bit,
+                     std::vector<au_evclass_map_t> &mappings,
+                     std::string &unknown);
+
+// The event to class mappings that remove `class_bit` from every event that
+// has it, restoring the mapping from before `profileMappings`.
+std::vector<au_evclass_map_t>
+unprofileMappings(const std::vector<AuditEvent> &events, au_class_t class_bit);
+
+// Sets the kernel's event to class mappings, in order. Returns false on
+// failure, with errno set, and the number set before it in `applied`.
+bool setEventClasses(const std::vector<au_evclass_map_t> &mappings,
+                     size_t &applied);
+
+// Sets the mappings of `profileMappings`, or on failure, restores those
+// already set, so that no partial profile is left. Returns false on failure,
+// with errno set.
+bool applyProfile(std::vector<au_evclass_map_t> mappings,
+                  au_class_t class_bit);
+
+// Like `auditon profile`, maps exactly the named events to an unused class,
+// so that preselecting its bit delivers only them, without changing what
+// readers of the system's classes get. Returns the class bit, or 0 on
+// failure, with errno set: ENOENT for an unknown event name, or ENOSPC when
+// every bit is in use. Undo it with `unprofileEvents`.
+au_class_t profileEvents(const std::vector<std::string> &names);
+bool unprofileEvents(au_class_t class_bit);
+
+// Like getauditflagsbin(3), but also accepts class masks as hex numbers, for
+// classes without a name, like those made by `auditon profile`. For example:
+// "+0x00400000,fc".
+bool parseEventClasses(const char *event_classes, au_mask_t &masks);
+
+} // namespace knox
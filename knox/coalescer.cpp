@@ -0,0 +1,236 @@
+#include "coalescer.h"
+#include "events.h"
+#include "tokens.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace knox {
+
+// Entries are found by probing this many slots from the hashed slot.
+static const size_t probe_count = 8;
+
+namespace {
+
+// The coalescing key of a record, from a single scan of its tokens.
+struct RecordKey {
+  explicit RecordKey(std::string &paths) : paths(paths) { paths.clear(); }
+
+  pid_t pid = 0;
+  bool has_subject = false;
+  bool lifecycle = false;
+  u_char status = 0;
+  u_int64_t value = 0;
+  // All paths, NUL separated, for example both paths of a rename.
+  std::string &paths;
+
+  template <u_char Id>
+  bool operator()(TokenTag<Id> tag, const tokenstr_t &token) {
+    if (Id == AUT_PROCESS32 || Id == AUT_PROCESS32_EX || Id == AUT_PROCESS64 ||
+        Id == AUT_PROCESS64_EX) {
+      // Process tokens are the target of kill, wait, etc.
+      lifecycle = true;
+      return false;
+    }
+    if (not has_subject) {
+      pid = tokenPid(tag, token);
+      has_subject = true;
+    }
+    return true;
+  }
+
+  bool operator()(TokenTag<AUT_EXEC_ARGS>, const tokenstr_t &token) {
+    lifecycle = true;
+    return false;
+  }
+
+  bool operator()(TokenTag<AUT_RETURN32>, const tokenstr_t &token) {
+    status = token.tt.ret32.status;
+    value = token.tt.ret32.ret;
+    return true;
+  }
+
+  bool operator()(TokenTag<AUT_RETURN64>, const tokenstr_t &token) {
+    status = token.tt.ret64.err;
+    value = token.tt.ret64.val;
+    return true;
+  }
+
+  bool operator()(TokenTag<AUT_PATH>, const tokenstr_t &token) {
+    auto path = FileEvent::pathRef(token.tt.path);
+    paths.append(path.data, path.size);
+    paths.push_back('\0');
+    return true;
+  }
+};
+
+using KeyScanner =
+    TokenScanner<AUT_PROCESS32, AUT_PROCESS32_EX, AUT_PROCESS64,
+                 AUT_PROCESS64_EX, AUT_SUBJECT32, AUT_SUBJECT32_EX,
+                 AUT_SUBJECT64, AUT_SUBJECT64_EX, AUT_EXEC_ARGS, AUT_RETURN32,
+                 AUT_RETURN64, AUT_PATH>;
+
+// FNV-1a
+struct Hash {
+  u_int64_t value = 0xcbf29ce484222325ull;
+
+  void add(const void *data, size_t size) {
+    auto bytes = (const u_char *)data;
+    for (size_t i = 0; i < size; ++i) {
+      value ^= bytes[i];
+      value *= 0x100000001b3ull;
+    }
+  }
+
+  template <typename T> void add(const T &scalar) {
+    add(&scalar, sizeof(scalar));
+  }
+};
+
+} // namespace
+
+Coalescer::Coalescer(u_int64_t window_milliseconds, size_t capacity,
+                     Emit emit)
+    : _window(window_milliseconds), _emit(std::move(emit)) {
+  size_t size = probe_count;
+  while (size < capacity) {
+    size *= 2;
+  }
+  _entries.resize(size);
+}
+
+bool Coalescer::emit(const Record &record) {
+  ++_output_count;
+  return _emit(record);
+}
+
+bool Coalescer::emit(Entry &entry) {
+  entry.used = false;
+  Record record{entry.record.data(), entry.record.size()};
+  if (entry.count == 1) {
+    return emit(record);
+  }
+
+  char text[96];
+  snprintf(text, sizeof(text), "coalesced %u records, last %llu.%03llu",
+           entry.count, (unsigned long long)entry.last / 1000,
+           (unsigned long long)entry.last % 1000);
+  _builder.begin(record);
+  _builder.text(text);
+  return emit(_builder.finish());
+}
+
+bool Coalescer::expire(u_int64_t now) {
+  _expiring.clear();
+  for (auto &entry : _entries) {
+    if (entry.used && now > entry.first + _window) {
+      _expiring.push_back(&entry);
+    }
+  }
+
+  std::sort(_expiring.begin(), _expiring.end(),
+            [](Entry *a, Entry *b) { return a->first < b->first; });
+  for (auto entry : _expiring) {
+    if (not emit(*entry)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Coalescer::add(const Record &record) {
+  ++_input_count;
+
+  u_int64_t seconds, milliseconds;
+  if (not record.time(seconds, milliseconds)) {
+    return emit(record);
+  }
+  const auto time = seconds * 1000 + milliseconds;
+  _now = std::max(_now, time);
+
+  // Expired entries wait at most another window, at the cost of a pass over
+  // the table per window, rather than per record.
+  if (_now >= _expired + std::max<u_int64_t>(_window, 10)) {
+    _expired = _now;
+    if (not expire(_now)) {
+      return false;
+    }
+  }
+
+  if (isLifecycleEvent(record.event())) {
+    return emit(record);
+  }
+
+  RecordKey key{_paths};
+  if (not KeyScanner::scan(record, key) || key.lifecycle ||
+      not key.has_subject) {
+    return emit(record);
+  }
+
+  const auto event = record.event();
+  Hash hash;
+  hash.add(key.pid);
+  hash.add(event);
+  hash.add(key.status);
+  hash.add(key.value);
+  hash.add(_paths.data(), _paths.size());
+
+  const auto mask = _entries.size() - 1;
+  Entry *free = nullptr;
+  Entry *oldest = nullptr;
+  for (size_t i = 0; i < probe_count; ++i) {
+    auto &entry = _entries[(hash.value + i) & mask];
+    if (not entry.used) {
+      if (not free) {
+        free = &entry;
+      }
+      continue;
+    }
+
+    if (entry.hash == hash.value && entry.pid == key.pid &&
+        entry.event == event && entry.status == key.status &&
+        entry.value == key.value && entry.path == _paths) {
+      if (time <= entry.first + _window) {
+        ++entry.count;
+        entry.last = std::max(entry.last, time);
+        return true;
+      }
+
+      // The window has passed, start a new one.
+      if (not emit(entry)) {
+        return false;
+      }
+      free = &entry;
+      break;
+    }
+
+    if (not oldest || entry.first < oldest->first) {
+      oldest = &entry;
+    }
+  }
+
+  if (not free) {
+    if (not emit(*oldest)) {
+      return false;
+    }
+    free = oldest;
+  }
+
+  auto &entry = *free;
+  entry.used = true;
+  entry.hash = hash.value;
+  entry.pid = key.pid;
+  entry.event = event;
+  entry.status = key.status;
+  entry.value = key.value;
+  entry.path.assign(_paths);
+  entry.first = time;
+  entry.last = time;
+  entry.count = 1;
+  entry.record.assign(record.data(), record.data() + record.size());
+  return true;
+}
+
+bool Coalescer::flush() { return expire(UINT64_MAX); }
+
+} // namespace knox
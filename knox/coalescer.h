@@ -0,0 +1,82 @@
+#pragma once
+
+#include "builder.h"
+#include "record.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace knox {
+
+// Collapses repeated identical events, for example the many stats of the
+// same header by the same compiler process. Records that match on pid, event
+// type, return, and path, within a time window of the first, become a single
+// record: the first record with a text token of the count and the time of the
+// last, like "coalesced 42 records, last 1700000000.123".
+//
+// Pending records are held in a fixed size hash table, and emitted when
+// their window has passed, when their slot is needed, or on `flush`. So,
+// output is in order of emission, not of record time. Expired records are
+// emitted once per window of record time, and by `expire`, which readers
+// call when input is idle. Records of process lifecycle events (fork, exec,
+// exit, or with process tokens) and records without a subject, are never
+// coalesced and are emitted immediately.
+class Coalescer {
+public:
+  using Emit = std::function<bool(const Record &)>;
+
+  // `capacity` is rounded up to a power of two. `emit` returns false to stop.
+  Coalescer(u_int64_t window_milliseconds, size_t capacity, Emit emit);
+
+  // Returns false if `emit` did.
+  bool add(const Record &record);
+
+  // Emits the records whose window has passed by `now`, in record time,
+  // milliseconds since the epoch, for example when input is idle.
+  bool expire(u_int64_t now);
+
+  // The latest record time added, or 0.
+  u_int64_t now() const { return _now; }
+
+  // Emits all pending records.
+  bool flush();
+
+  u_int64_t inputCount() const { return _input_count; }
+  u_int64_t outputCount() const { return _output_count; }
+
+private:
+  struct Entry {
+    bool used = false;
+    u_int64_t hash;
+    pid_t pid;
+    au_event_t event;
+    u_char status;
+    u_int64_t value;
+    std::string path;
+    u_int64_t first;
+    u_int64_t last;
+    u_int32_t count;
+    std::vector<u_char> record;
+  };
+
+  bool emit(const Record &record);
+  bool emit(Entry &entry);
+
+  u_int64_t _window;
+  std::vector<Entry> _entries;
+  u_int64_t _now = 0;
+  // The record time of the last expiry.
+  u_int64_t _expired = 0;
+  // The entries being emitted by `expire`, reused to avoid allocating.
+  std::vector<Entry *> _expiring;
+  // The paths of the record being added, reused to avoid allocating.
+  std::string _paths;
+  Emit _emit;
+  RecordBuilder _builder;
+
+  u_int64_t _input_count = 0;
+  u_int64_t _output_count = 0;
+};
+
+} // namespace knox
@@ -0,0 +1,115 @@
+#include "events.h"
+
+namespace knox {
+
+pid_t subjectPid(const Record &record) {
+  using SubjectTokenScanner = TokenScanner<AUT_SUBJECT32, AUT_SUBJECT32_EX,
+                                           AUT_SUBJECT64, AUT_SUBJECT64_EX>;
+  pid_t pid = 0;
+  auto handler = [&](auto tag, const tokenstr_t &token) {
+    pid = tokenPid(tag, token);
+    return false;
+  };
+  SubjectTokenScanner::scan(record, handler);
+  return pid;
+}
+
+StringRef commandName(const char *path) {
+  auto length = strlen(path);
+  // Like basename(3), ignore trailing slashes.
+  while (length > 1 && path[length - 1] == '/') {
+    --length;
+  }
+  auto start = length;
+  while (start > 0 && path[start - 1] != '/') {
+    --start;
+  }
+  return {path + start, length - start};
+}
+
+pid_t ExecEvent::pid() const { return subjectPid(*_record); }
+
+bool ExecEvent::args(au_execarg_t &args) const {
+  tokenstr_t token;
+  if (not _record->find(AUT_EXEC_ARGS, token)) {
+    return false;
+  }
+  args = token.tt.execarg;
+  return true;
+}
+
+bool ExecEvent::env(au_execenv_t &env) const {
+  tokenstr_t token;
+  if (not _record->find(AUT_EXEC_ENV, token)) {
+    return false;
+  }
+  env = token.tt.execenv;
+  return true;
+}
+
+StringRef ExecEvent::path() const {
+  tokenstr_t token;
+  if (not _record->findLast(AUT_PATH, token)) {
+    return {};
+  }
+  return FileEvent::pathRef(token.tt.path);
+}
+
+StringRef ExecEvent::command() const {
+  tokenstr_t token;
+  if (not _record->find(AUT_EXEC_ARGS, token) ||
+      token.tt.execarg.count == 0) {
+    return {};
+  }
+
+  return commandName(token.tt.execarg.text[0]);
+}
+
+pid_t FileEvent::pid() const { return subjectPid(*_record); }
+
+StringRef FileEvent::pathRef(const au_path_t &path) {
+  // The token length includes the trailing NUL.
+  return {path.path, strnlen(path.path, path.len)};
+}
+
+StringRef FileEvent::path() const {
+  tokenstr_t token;
+  if (not _record->find(AUT_PATH, token)) {
+    return {};
+  }
+  return pathRef(token.tt.path);
+}
+
+u_char FileEvent::status() const {
+  tokenstr_t token;
+  if (not _record->find(AUT_RETURN32, token)) {
+    return 0;
+  }
+  return token.tt.ret32.status;
+}
+
+u_int32_t FileEvent::returnValue() const {
+  tokenstr_t token;
+  if (not _record->find(AUT_RETURN32, token)) {
+    return 0;
+  }
+  return token.tt.ret32.ret;
+}
+
+pid_t ProcessEvent::subjectPid() const { return knox::subjectPid(*_record); }
+
+pid_t ProcessEvent::childPid() const {
+  pid_t pid = 0;
+  auto handler = [&](TokenTag<AUT_ARG32>, const tokenstr_t &token) {
+    auto &arg = token.tt.arg32;
+    if (arg.len > 0 && strcmp(arg.text, "child PID") == 0) {
+      pid = arg.val;
+      return false;
+    }
+    return true;
+  };
+  TokenScanner<AUT_ARG32>::scan(*_record, handler);
+  return pid;
+}
+
+} // namespace knox
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "record.h"
+#include "tokens.h"
+
+namespace knox {
+
+// Typed views of a record. Views are non-owning and move-only, like `Record`,
+// and must not outlive it. Accessors decode tokens on demand, none allocate.
+
+// The event of records that the tools make, like the alerts of `execrate`.
+// It's in the range audit_event(5) leaves to third parties, and isn't an
+// exec, fork or exit, so readers downstream don't take these records for
+// process events.
+const au_event_t AUE_KNOX_ALERT = 32900;
+
+// Whether records of the event are exec records, with exec args.
+inline bool isExecEvent(au_event_t event) {
+  return event == AUE_EXECVE || event == AUE_POSIX_SPAWN ||
+         event == AUE_MAC_EXECVE || event == AUE_EXEC;
+}
+
+// Whether records of the event start or end a process: fork, exec or exit.
+inline bool isLifecycleEvent(au_event_t event) {
+  return isExecEvent(event) || event == AUE_FORK || event == AUE_VFORK ||
+         event == AUE_EXIT;
+}
+
+// An `execve` or `posix_spawn` record.
+class ExecEvent {
+public:
+  explicit ExecEvent(const Record &record) : _record(&record) {}
+
+  ExecEvent(ExecEvent &&) = default;
+  ExecEvent &operator=(ExecEvent &&) = default;
+  ExecEvent(const ExecEvent &) = delete;
+  ExecEvent &operator=(const ExecEvent &) = delete;
+
+  au_event_t event() const { return _record->event(); }
+
+  // The pid of the subject, which for posix_spawn is the parent process.
+  pid_t pid() const;
+
+  // The exec args and env tokens. Returns false if the record has none.
+  bool args(au_execarg_t &args) const;
+  bool env(au_execenv_t &env) const;
+
+  // The last path token, which is expected to be the final resolved path of
+  // the executable.
+  //
+  // Audit events can contain more than one `au_path_t` token, and they
+  // appear to show the command path being resolved step by step. From
+  // relative to absolute, and from symlink to real path.
+  StringRef path() const;
+
+  // The basename of the first exec arg.
+  StringRef command() const;
+
+private:
+  const Record *_record;
+};
+
+// A file access record: open, read, stat, unlink, etc.
+class FileEvent {
+public:
+  explicit FileEvent(const Record &record) : _record(&record) {}
+
+  FileEvent(FileEvent &&) = default;
+  FileEvent &operator=(FileEvent &&) = default;
+  FileEvent(const FileEvent &) = delete;
+  FileEvent &operator=(const FileEvent &) = delete;
+
+  au_event_t event() const { return _record->event(); }
+  pid_t pid() const;
+
+  // The first path token, or an empty path.
+  StringRef path() const;
+
+  // Calls `f(StringRef)` for every path token, for example both paths of a
+  // rename.
+  template <typename F> void forEachPath(F &&f) const {
+    auto handler = [&](TokenTag<AUT_PATH>, const tokenstr_t &token) {
+      f(pathRef(token.tt.path));
+      return true;
+    };
+    TokenScanner<AUT_PATH>::scan(*_record, handler);
+  }
+
+  // The error number of the return token, 0 on success.
+  u_char status() const;
+  // The return value of the return token.
+  u_int32_t returnValue() const;
+
+  static StringRef pathRef(const au_path_t &path);
+
+private:
+  const Record *_record;
+};
+
+// A process lifecycle record: fork, exec, exit, kill, etc.
+class ProcessEvent {
+public:
+  explicit ProcessEvent(const Record &record) : _record(&record) {}
+
+  ProcessEvent(ProcessEvent &&) = default;
+  ProcessEvent &operator=(ProcessEvent &&) = default;
+  ProcessEvent(const ProcessEvent &) = delete;
+  ProcessEvent &operator=(const ProcessEvent &) = delete;
+
+  au_event_t event() const { return _record->event(); }
+  bool isExit() const { return event() == AUE_EXIT; }
+
+  // The pid of the subject, the process that generated the event.
+  pid_t subjectPid() const;
+
+  // For posix_spawn, the subject pid is the parent process. The child pid
+  // comes from the arg token named "child PID". Returns 0 if there is none.
+  pid_t childPid() const;
+
+  // Calls `f(pid_t)` for the pid of every process and subject token.
+  template <typename F> void forEachPid(F &&f) const {
+    auto handler = [&](auto tag, const tokenstr_t &token) {
+      f(tokenPid(tag, token));
+      return true;
+    };
+    ProcessTokenScanner::scan(*_record, handler);
+  }
+
+private:
+  const Record *_record;
+};
+
+// The basename of a command path, without copying it.
+StringRef commandName(const char *path);
+
+// The pid of the first subject token of a record, or 0.
+pid_t subjectPid(const Record &record);
+
+} // namespace knox
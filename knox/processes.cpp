@@ -0,0 +1,230 @@
+#include "processes.h"
+#include "events.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__APPLE__)
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#else
+#include <climits>
+#include <cstdio>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace knox {
+
+#if defined(__APPLE__)
+
+bool listProcesses(std::vector<ProcessInfo> &processes) {
+  int mib[] = {CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0};
+  std::vector<kinfo_proc> table;
+  size_t size = 0;
+  while (true) {
+    if (sysctl(mib, 4, nullptr, &size, nullptr, 0) != 0) {
+      return false;
+    }
+    // Room for processes started between the two calls.
+    table.resize(size / sizeof(kinfo_proc) + 64);
+    size = table.size() * sizeof(kinfo_proc);
+    if (sysctl(mib, 4, table.data(), &size, nullptr, 0) == 0) {
+      break;
+    }
+    if (errno != ENOMEM) {
+      return false;
+    }
+  }
+  table.resize(size / sizeof(kinfo_proc));
+
+  processes.clear();
+  processes.reserve(table.size());
+  for (auto &process : table) {
+    auto &start = process.kp_proc.p_starttime;
+    ProcessInfo info;
+    info.pid = process.kp_proc.p_pid;
+    info.parent_pid = process.kp_eproc.e_ppid;
+    info.start_time = start.tv_sec * 1000ull + start.tv_usec / 1000;
+    info.command = process.kp_proc.p_comm;
+    if (info.command.size() >= MAXCOMLEN) {
+      // Possibly truncated, so get the whole name from the path.
+      auto path = processPath(info.pid);
+      if (not path.empty()) {
+        info.command = commandName(path.c_str()).str();
+      }
+    }
+    processes.push_back(std::move(info));
+  }
+  return true;
+}
+
+std::string processPath(pid_t pid) {
+  int argmax_mib[] = {CTL_KERN, KERN_ARGMAX};
+  int argmax = ARG_MAX;
+  auto argmax_size = sizeof(argmax);
+  if (sysctl(argmax_mib, 2, &argmax, &argmax_size, NULL, 0) != 0) {
+    return {};
+  }
+
+  std::vector<char> procargs(argmax);
+
+  int procargs_mib[] = {CTL_KERN, KERN_PROCARGS2, pid};
+  size_t procargs_size = argmax;
+  if (sysctl(procargs_mib, 3, procargs.data(), &procargs_size, NULL, 0) != 0 ||
+      procargs_size <= sizeof(int)) {
+    // Can happen if the pid is already gone.
+    return {};
+  }
+
+  // Skip past argc count.
+  auto exec_path = procargs.data() + sizeof(int);
+  return {exec_path, strnlen(exec_path, procargs_size - sizeof(int))};
+}
+
+u_int64_t processStartTime(pid_t pid) {
+  int mib[] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, pid};
+  kinfo_proc process;
+  size_t size = sizeof(process);
+  if (sysctl(mib, 4, &process, &size, nullptr, 0) != 0 || size == 0) {
+    return 0;
+  }
+  auto &start = process.kp_proc.p_starttime;
+  return start.tv_sec * 1000ull + start.tv_usec / 1000;
+}
+
+#else
+
+// The boot time, in seconds since the epoch, from the btime line of
+// /proc/stat.
+static bool bootTime(u_int64_t &seconds) {
+  auto file = fopen("/proc/stat", "r");
+  if (not file) {
+    return false;
+  }
+  char line[256];
+  bool found = false;
+  while (not found && fgets(line, sizeof(line), file)) {
+    unsigned long long btime;
+    if (sscanf(line, "btime %llu", &btime) == 1) {
+      seconds = btime;
+      found = true;
+    }
+  }
+  fclose(file);
+  if (not found) {
+    errno = EINVAL;
+  }
+  return found;
+}
+
+// Reads the parent pid, start time in clock ticks since boot, and (possibly
+// truncated) command name, from /proc/<pid>/stat.
+static bool readStat(pid_t pid, pid_t &parent_pid,
+                     unsigned long long &start_ticks, std::string &command) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  auto file = fopen(path, "r");
+  if (not file) {
+    return false;
+  }
+  char stat[1024];
+  auto size = fread(stat, 1, sizeof(stat) - 1, file);
+  fclose(file);
+  stat[size] = '\0';
+
+  // The command is in parentheses, and can itself contain them.
+  auto open = strchr(stat, '(');
+  auto close = strrchr(stat, ')');
+  if (not open || not close || close < open) {
+    return false;
+  }
+  command.assign(open + 1, close);
+
+  // Skip from the state, the 3rd field, to the start time, the 22nd.
+  auto field = close + 2;
+  for (int i = 3; i < 22 && field; ++i) {
+    if (i == 4) {
+      parent_pid = strtol(field, nullptr, 10);
+    }
+    field = strchr(field, ' ');
+    if (field) {
+      ++field;
+    }
+  }
+  if (not field) {
+    return false;
+  }
+  start_ticks = strtoull(field, nullptr, 10);
+  return true;
+}
+
+bool listProcesses(std::vector<ProcessInfo> &processes) {
+  u_int64_t boot_time;
+  if (not bootTime(boot_time)) {
+    return false;
+  }
+  const u_int64_t ticks_per_second = sysconf(_SC_CLK_TCK);
+
+  auto proc = opendir("/proc");
+  if (not proc) {
+    return false;
+  }
+
+  processes.clear();
+  while (auto entry = readdir(proc)) {
+    char *end;
+    auto pid = (pid_t)strtol(entry->d_name, &end, 10);
+    if (*end != '\0' || pid <= 0) {
+      continue;
+    }
+
+    ProcessInfo info;
+    info.pid = pid;
+    unsigned long long start_ticks;
+    if (not readStat(pid, info.parent_pid, start_ticks, info.command)) {
+      // The process exited since the directory was read.
+      continue;
+    }
+    info.start_time =
+        boot_time * 1000 + start_ticks * 1000 / ticks_per_second;
+    // The stat command name is truncated, the path is not, but reading it
+    // needs permission.
+    auto path = processPath(pid);
+    if (not path.empty()) {
+      info.command = commandName(path.c_str()).str();
+    }
+    processes.push_back(std::move(info));
+  }
+  closedir(proc);
+  return true;
+}
+
+std::string processPath(pid_t pid) {
+  char link[32];
+  snprintf(link, sizeof(link), "/proc/%d/exe", pid);
+  char path[PATH_MAX];
+  auto size = readlink(link, path, sizeof(path));
+  if (size <= 0) {
+    return {};
+  }
+  return {path, (size_t)size};
+}
+
+u_int64_t processStartTime(pid_t pid) {
+  u_int64_t boot_time;
+  pid_t parent_pid;
+  unsigned long long start_ticks;
+  std::string command;
+  if (not bootTime(boot_time) ||
+      not readStat(pid, parent_pid, start_ticks, command)) {
+    return 0;
+  }
+  const u_int64_t ticks_per_second = sysconf(_SC_CLK_TCK);
+  return boot_time * 1000 + start_ticks * 1000 / ticks_per_second;
+}
+
+#endif
+
+} // namespace knox
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace knox {
+
+// A running process, from a snapshot of the process table.
+struct ProcessInfo {
+  pid_t pid;
+  pid_t parent_pid;
+  // Milliseconds since the epoch, like record times.
+  u_int64_t start_time;
+  // The basename of the executable, like ExecEvent::command().
+  std::string command;
+};
+
+// Reads the whole process table in one query, KERN_PROC_ALL on macOS, or
+// /proc elsewhere. Returns false with errno set on failure.
+bool listProcesses(std::vector<ProcessInfo> &processes);
+
+// The path of the executable of a running process, or empty if the process
+// is gone.
+std::string processPath(pid_t pid);
+
+// The start time of a running process, in milliseconds since the epoch, or 0
+// if the process is gone.
+u_int64_t processStartTime(pid_t pid);
+
+// Per process state, for tools that follow processes over weeks. Entries are
+// keyed by pid and a generation, the time the process was first seen, forked
+// or exec'd, so that a recycled pid doesn't inherit the state of the process
+// that had it before.
+//
+// Memory is bounded by `capacity`. When it's full, an entry is evicted using
+// CLOCK: entries are referenced when found, and the clock hand evicts the
+// first entry that hasn't been referenced since it last passed. Entries
+// should also be erased on exit events, so that eviction is rare.
+template <typename State> class ProcessCache {
+public:
+  struct Entry {
+    pid_t pid;
+    u_int64_t generation;
+    State state;
+  };
+
+  explicit ProcessCache(size_t capacity) : _slots(capacity ? capacity : 1) {
+    size_t size = 2;
+    while (size < _slots.size() * 2) {
+      size *= 2;
+    }
+    _index.assign(size, empty);
+    _free.reserve(_slots.size());
+    for (size_t i = _slots.size(); i > 0; --i) {
+      _free.push_back(i - 1);
+    }
+  }
+
+  // The entry of `pid`, or null if it's not cached.
+  Entry *find(pid_t pid) {
+    auto position = indexOf(pid);
+    if (_index[position] == empty) {
+      return nullptr;
+    }
+    auto &slot = _slots[_index[position]];
+    slot.referenced = true;
+    return &slot.entry;
+  }
+
+  // Like `find`, but only if the entry is of the given generation or newer.
+  // An older entry is of a previous process with the same pid, and is erased.
+  Entry *find(pid_t pid, u_int64_t generation) {
+    auto entry = find(pid);
+    if (entry && entry->generation < generation) {
+      erase(pid);
+      return nullptr;
+    }
+    return entry;
+  }
+
+  // Adds or replaces the entry of `pid`, evicting another entry if full.
+  Entry &insert(pid_t pid, u_int64_t generation, const State &state) {
+    auto position = indexOf(pid);
+    if (_index[position] == empty) {
+      if (_free.empty()) {
+        evict();
+        position = indexOf(pid);
+      }
+      _index[position] = _free.back();
+      _free.pop_back();
+    }
+
+    auto &slot = _slots[_index[position]];
+    slot.used = true;
+    slot.referenced = true;
+    slot.entry = {pid, generation, state};
+    return slot.entry;
+  }
+
+  void erase(pid_t pid) {
+    auto position = indexOf(pid);
+    if (_index[position] == empty) {
+      return;
+    }
+    auto &slot = _slots[_index[position]];
+    slot.used = false;
+    _free.push_back(_index[position]);
+    unindex(position);
+  }
+
+  size_t size() const { return _slots.size() - _free.size(); }
+  size_t capacity() const { return _slots.size(); }
+  u_int64_t evictions() const { return _evictions; }
+
+private:
+  static const u_int32_t empty = UINT32_MAX;
+
+  struct Slot {
+    bool used = false;
+    bool referenced = false;
+    Entry entry;
+  };
+
+  // The murmur3 finalizer, to spread sequential pids.
+  size_t hash(pid_t pid) const {
+    u_int32_t hash = pid;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash & (_index.size() - 1);
+  }
+
+  // The index position of `pid`, or the empty position where it would go.
+  // Linear probing, the index is at most half full.
+  size_t indexOf(pid_t pid) const {
+    const auto mask = _index.size() - 1;
+    auto position = hash(pid);
+    while (_index[position] != empty &&
+           _slots[_index[position]].entry.pid != pid) {
+      position = (position + 1) & mask;
+    }
+    return position;
+  }
+
+  // Empties an index position, shifting back the entries that probed past
+  // it, so that lookups don't need tombstones.
+  void unindex(size_t position) {
+    const auto mask = _index.size() - 1;
+    auto next = position;
+    while (true) {
+      next = (next + 1) & mask;
+      if (_index[next] == empty) {
+        break;
+      }
+      auto home = hash(_slots[_index[next]].entry.pid);
+      // Move the entry back if its home isn't cyclically in (position, next].
+      if (((next - home) & mask) >= ((next - position) & mask)) {
+        _index[position] = _index[next];
+        position = next;
+      }
+    }
+    _index[position] = empty;
+  }
+
+  void evict() {
+    while (true) {
+      auto &slot = _slots[_hand];
+      _hand = (_hand + 1) % _slots.size();
+      if (not slot.used) {
+        continue;
+      }
+      if (slot.referenced) {
+        slot.referenced = false;
+        continue;
+      }
+      ++_evictions;
+      erase(slot.entry.pid);
+      return;
+    }
+  }
+
+  std::vector<Slot> _slots;
+  // Open addressed, from pid to the position in `_slots`.
+  std::vector<u_int32_t> _index;
+  std::vector<u_int32_t> _free;
+  size_t _hand = 0;
+  u_int64_t _evictions = 0;
+};
+
+template <typename State> const u_int32_t ProcessCache<State>::empty;
+
+} // namespace knox
@@ -0,0 +1,146 @@
+#include "rates.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace knox {
+
+// Entries are found by probing this many slots from the hashed slot.
+static const size_t probe_count = 8;
+
+// FNV-1a
+static u_int64_t hashName(const char *data, size_t size) {
+  u_int64_t value = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; ++i) {
+    value ^= (u_char)data[i];
+    value *= 0x100000001b3ull;
+  }
+  return value;
+}
+
+RateDetector::RateDetector(size_t capacity, double multiple,
+                           double minimum_rate, double half_life,
+                           u_int64_t warmup)
+    : _multiple(multiple), _minimum_rate(minimum_rate), _warmup(warmup) {
+  size_t size = probe_count;
+  while (size < capacity) {
+    size *= 2;
+  }
+  _entries.resize(size);
+
+  _decay = std::pow(0.5, 1 / std::max(half_life, 1.0));
+  _alpha = 1 - _decay;
+}
+
+double RateDetector::threshold(const Entry &entry) const {
+  return std::max({_minimum_rate, _multiple * entry.mean,
+                   entry.mean + 3 * std::sqrt(entry.variance)});
+}
+
+void RateDetector::advance(Entry &entry, u_int64_t second) {
+  if (second <= entry.second) {
+    // The same second, or a record that's slightly out of order.
+    return;
+  }
+
+  if (entry.count < threshold(entry) || second > entry.second + 1) {
+    entry.alerting = false;
+  }
+
+  // The incremental form of the weighted mean and variance.
+  const double diff = entry.count - entry.mean;
+  const double increment = _alpha * diff;
+  entry.mean += increment;
+  entry.variance = _decay * (entry.variance + diff * increment);
+
+  // Seconds without events, in closed form, rather than one by one: after k
+  // zeros, the mean decays by decay^k, and the variance to
+  // decay^k * (variance + mean^2 * (1 - decay^k)).
+  const auto empty_seconds = second - entry.second - 1;
+  if (empty_seconds > 0) {
+    const double decay = std::pow(_decay, (double)empty_seconds);
+    entry.variance =
+        decay * (entry.variance + entry.mean * entry.mean * (1 - decay));
+    entry.mean *= decay;
+  }
+
+  entry.second = second;
+  entry.count = 0;
+}
+
+bool RateDetector::add(StringRef command, u_int64_t time, Alert &alert) {
+  const auto size = std::min(command.size, sizeof(Entry::name));
+  const auto hash = hashName(command.data, size);
+  const auto second = time / 1000;
+
+  const auto mask = _entries.size() - 1;
+  Entry *found = nullptr;
+  Entry *free = nullptr;
+  Entry *idlest = nullptr;
+  double idlest_rate = 0;
+  for (size_t i = 0; i < probe_count; ++i) {
+    auto &entry = _entries[(hash + i) & mask];
+    if (not entry.used) {
+      if (not free) {
+        free = &entry;
+      }
+      continue;
+    }
+
+    if (entry.hash == hash && entry.size == size &&
+        memcmp(entry.name, command.data, size) == 0) {
+      found = &entry;
+      break;
+    }
+
+    // The rate the entry's baseline has decayed to by now.
+    auto rate = entry.mean + entry.count;
+    if (second > entry.second) {
+      rate *= std::pow(_decay, (double)(second - entry.second));
+    }
+    if (not idlest || rate < idlest_rate) {
+      idlest = &entry;
+      idlest_rate = rate;
+    }
+  }
+
+  if (not found) {
+    if (free) {
+      ++_size;
+    } else {
+      free = idlest;
+      ++_evictions;
+    }
+
+    found = free;
+    found->used = true;
+    found->alerting = false;
+    found->size = size;
+    memcpy(found->name, command.data, size);
+    found->hash = hash;
+    found->first = second;
+    found->second = second;
+    found->count = 0;
+    found->mean = 0;
+    found->variance = 0;
+  }
+
+  auto &entry = *found;
+  advance(entry, second);
+  ++entry.count;
+
+  if (entry.alerting || second < entry.first + _warmup ||
+      entry.count < threshold(entry)) {
+    return false;
+  }
+
+  entry.alerting = true;
+  alert.command = {entry.name, entry.size};
+  alert.rate = entry.count;
+  alert.baseline = entry.mean;
+  alert.deviation = std::sqrt(entry.variance);
+  return true;
+}
+
+} // namespace knox
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "record.h"
+
+#include <vector>
+
+namespace knox {
+
+// Detects commands whose event rate jumps, for example a crashing daemon that
+// is respawned 50 times a second, or a fork storm. Events are counted per
+// command, per second of record time. As each second closes, its count is
+// folded into an exponentially weighted moving average and variance of the
+// command's rate, its baseline.
+//
+// A command's rate jumps when its count in the current second passes all of:
+// `multiple` times its baseline, its baseline plus 3 standard deviations, and
+// `minimum_rate`. It's reported once, as soon as it passes, then not again
+// until a second closes below the threshold. A command has no baseline when
+// first seen, so it isn't reported until it has been seen for `warmup`
+// seconds, otherwise every busy command would be reported on startup, and
+// every new command with a burst of forks.
+//
+// Commands are kept in a fixed size hash table, and an event costs a hash,
+// a few probes and a few multiplies, whatever the time since the command was
+// last seen. When the probed slots are full, the least active command is
+// evicted. Command names are truncated to 31 bytes.
+class RateDetector {
+public:
+  struct Alert {
+    // Valid until the next call to `add`.
+    StringRef command;
+    // Events in the current second.
+    u_int32_t rate;
+    // Events per second, and their standard deviation.
+    double baseline;
+    double deviation;
+  };
+
+  // `capacity` is rounded up to a power of two. The weight of a second in the
+  // baseline halves every `half_life` seconds.
+  RateDetector(size_t capacity, double multiple, double minimum_rate,
+               double half_life, u_int64_t warmup);
+
+  // Counts an event of `command` at `time`, milliseconds since the epoch.
+  // Returns true when the command's rate has just jumped, with `alert` set.
+  bool add(StringRef command, u_int64_t time, Alert &alert);
+
+  size_t size() const { return _size; }
+  u_int64_t evictions() const { return _evictions; }
+
+private:
+  struct Entry {
+    bool used = false;
+    bool alerting = false;
+    u_char size;
+    char name[31];
+    u_int64_t hash;
+    // The second the command was first seen.
+    u_int64_t first;
+    // The current second, and its count.
+    u_int64_t second;
+    u_int32_t count;
+    double mean;
+    double variance;
+  };
+
+  // Folds the count of the entry's current second, and the seconds without
+  // events until `second`, into its baseline.
+  void advance(Entry &entry, u_int64_t second);
+  double threshold(const Entry &entry) const;
+
+  std::vector<Entry> _entries;
+  double _multiple;
+  double _minimum_rate;
+  u_int64_t _warmup;
+  // The weight of the last second, and the decay of a second.
+  double _alpha;
+  double _decay;
+  size_t _size = 0;
+  u_int64_t _evictions = 0;
+};
+
+} // namespace knox
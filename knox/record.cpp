@@ -0,0 +1,371 @@
+#include "record.h"
+#include "batch.h"
+#include "sampler.h"
+#include "stats.h"
+#include "tokens.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace knox {
+
+// Records larger than this are assumed to be garbage. The kernel's limit
+// (AUDITPIPE_GET_MAXAUDITDATA) is much smaller.
+static const size_t max_record_size = 1 << 24;
+
+static u_int16_t read16(const u_char *data) {
+  return (u_int16_t)data[0] << 8 | data[1];
+}
+
+static u_int32_t read32(const u_char *data) {
+  return (u_int32_t)data[0] << 24 | (u_int32_t)data[1] << 16 |
+         (u_int32_t)data[2] << 8 | data[3];
+}
+
+static u_int64_t read64(const u_char *data) {
+  return (u_int64_t)read32(data) << 32 | read32(data + 4);
+}
+
+void TokenIterator::fetch() {
+  if (_remaining == 0) {
+    return;
+  }
+
+  stats::Timer timer{stats::Decode};
+  stats::count(stats::Tokens);
+  // A malformed token ends iteration, rather than looping on a zero length.
+  if (au_fetch_tok(&_token, (u_char *)_cursor, (int)_remaining) != 0 ||
+      _token.len == 0 || _token.len > _remaining) {
+    _cursor += _remaining;
+    _remaining = 0;
+  }
+}
+
+au_event_t Record::event() const {
+  // All header token variants have the event type at the same offset:
+  // id (1), size (4), version (1), event type (2).
+  if (_size < 8) {
+    return 0;
+  }
+
+  switch (_data[0]) {
+  case AUT_HEADER32:
+  case AUT_HEADER32_EX:
+  case AUT_HEADER64:
+  case AUT_HEADER64_EX:
+    return read16(_data + 6);
+  default:
+    return 0;
+  }
+}
+
+bool Record::time(u_int64_t &seconds, u_int64_t &milliseconds) const {
+  // The time follows id (1), size (4), version (1), event type (2), and
+  // event modifier (2). The _EX variants also have an address type and
+  // address before it.
+  size_t offset = 10;
+  bool is64 = false;
+  switch (_size > 0 ? _data[0] : 0) {
+  case AUT_HEADER32:
+    break;
+  case AUT_HEADER64:
+    is64 = true;
+    break;
+  case AUT_HEADER32_EX:
+  case AUT_HEADER64_EX:
+    if (_size < offset + 4) {
+      return false;
+    }
+    is64 = _data[0] == AUT_HEADER64_EX;
+    offset += 4 + read32(_data + offset);
+    break;
+  default:
+    return false;
+  }
+
+  if (is64) {
+    if (_size < offset + 16) {
+      return false;
+    }
+    seconds = read64(_data + offset);
+    milliseconds = read64(_data + offset + 8);
+  } else {
+    if (_size < offset + 8) {
+      return false;
+    }
+    seconds = read32(_data + offset);
+    milliseconds = read32(_data + offset + 4);
+  }
+  return true;
+}
+
+// Skips tokens by their size, decoding only the token that's found.
+bool Record::find(u_char id, tokenstr_t &token) const {
+  auto cursor = _data;
+  auto remaining = _size;
+  while (remaining > 0) {
+    if (*cursor == id) {
+      stats::Timer timer{stats::Decode};
+      stats::count(stats::Tokens);
+      return au_fetch_tok(&token, (u_char *)cursor, (int)remaining) == 0;
+    }
+    auto size = tokenSize(cursor, remaining);
+    if (size == 0) {
+      return false;
+    }
+    cursor += size;
+    remaining -= size;
+  }
+  return false;
+}
+
+bool Record::findLast(u_char id, tokenstr_t &token) const {
+  const u_char *found = nullptr;
+  auto cursor = _data;
+  auto remaining = _size;
+  while (remaining > 0) {
+    if (*cursor == id) {
+      found = cursor;
+    }
+    auto size = tokenSize(cursor, remaining);
+    if (size == 0) {
+      break;
+    }
+    cursor += size;
+    remaining -= size;
+  }
+
+  if (not found) {
+    return false;
+  }
+  stats::Timer timer{stats::Decode};
+  stats::count(stats::Tokens);
+  return au_fetch_tok(&token, (u_char *)found, (int)(_data + _size - found)) ==
+         0;
+}
+
+ssize_t recordSize(const u_char *data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  switch (data[0]) {
+  case AUT_HEADER32:
+  case AUT_HEADER32_EX:
+  case AUT_HEADER64:
+  case AUT_HEADER64_EX: {
+    if (size < 5) {
+      return 0;
+    }
+    auto record_size = read32(data + 1);
+    if (record_size < 18 || record_size > max_record_size) {
+      return -1;
+    }
+    return record_size;
+  }
+  case AUT_OTHER_FILE32: {
+    // id (1), seconds (4), milliseconds (4), name length (2), name.
+    if (size < 11) {
+      return 0;
+    }
+    return 11 + read16(data + 9);
+  }
+  default:
+    return -1;
+  }
+}
+
+Reader::Reader(int fd, bool owned, size_t buffer_size)
+    : _fd(fd), _owned(owned), _buffer(buffer_size) {
+  if (fd < 0) {
+    _error = errno;
+  }
+}
+
+Reader::Reader(Reader &&other)
+    : _fd(other._fd), _owned(other._owned), _error(other._error),
+      _sampler(other._sampler), _timeout(other._timeout),
+      _buffer(std::move(other._buffer)),
+      _start(other._start), _end(other._end) {
+  other._fd = -1;
+  other._owned = false;
+}
+
+Reader &Reader::operator=(Reader &&other) {
+  if (this != &other) {
+    if (_owned && _fd >= 0) {
+      close(_fd);
+    }
+    _fd = other._fd;
+    _owned = other._owned;
+    _error = other._error;
+    _sampler = other._sampler;
+    _timeout = other._timeout;
+    _buffer = std::move(other._buffer);
+    _start = other._start;
+    _end = other._end;
+    other._fd = -1;
+    other._owned = false;
+  }
+  return *this;
+}
+
+Reader::~Reader() {
+  if (_owned && _fd >= 0) {
+    close(_fd);
+  }
+}
+
+Reader Reader::open(const char *path) {
+  return Reader{::open(path, O_RDONLY)};
+}
+
+bool Reader::fill() {
+  if (_start == _end) {
+    _start = _end = 0;
+  } else if (_end == _buffer.size()) {
+    if (_start > 0) {
+      memmove(_buffer.data(), _buffer.data() + _start, _end - _start);
+      _end -= _start;
+      _start = 0;
+    } else {
+      stats::Timer timer{stats::Allocate};
+      stats::count(stats::Allocations);
+      _buffer.resize(_buffer.size() * 2);
+    }
+  }
+
+  if (_timeout >= 0) {
+    pollfd input{_fd, POLLIN, 0};
+    auto ready = poll(&input, 1, _timeout);
+    if (ready == -1) {
+      _error = errno;
+      return false;
+    }
+    if (ready == 0) {
+      _error = ETIMEDOUT;
+      return false;
+    }
+  }
+
+  stats::Timer timer{stats::Read};
+  auto read_size = read(_fd, _buffer.data() + _end, _buffer.size() - _end);
+  if (read_size == -1) {
+    _error = errno;
+    return false;
+  }
+
+  stats::count(stats::Bytes, read_size);
+  _end += read_size;
+  return read_size > 0;
+}
+
+bool Reader::next(Record &record) {
+  if (_fd < 0) {
+    return false;
+  }
+
+  stats::endRecord();
+  while (true) {
+    auto available = _end - _start;
+    auto size = recordSize(_buffer.data() + _start, available);
+    if (size < 0) {
+      _error = EINVAL;
+      return false;
+    }
+
+    if (size > 0 && (size_t)size <= available) {
+      record = Record{_buffer.data() + _start, (size_t)size};
+      _start += size;
+      if (_sampler) {
+        stats::Timer timer{stats::Match};
+        if (not _sampler->keep(record)) {
+          continue;
+        }
+      }
+      stats::count(stats::Records);
+      stats::beginRecord();
+      return true;
+    }
+
+    if (not more(size)) {
+      return false;
+    }
+  }
+}
+
+bool Reader::next(RecordBatch &batch) {
+  stats::endRecords(batch.size());
+  batch.clear();
+  if (_fd < 0) {
+    return false;
+  }
+
+  while (true) {
+    ssize_t size;
+    while (true) {
+      auto available = _end - _start;
+      size = recordSize(_buffer.data() + _start, available);
+      if (size <= 0 || (size_t)size > available) {
+        break;
+      }
+
+      Record record{_buffer.data() + _start, (size_t)size};
+      _start += size;
+      if (_sampler) {
+        stats::Timer timer{stats::Match};
+        if (not _sampler->keep(record)) {
+          continue;
+        }
+      }
+      stats::count(stats::Records);
+      batch.add(record);
+    }
+
+    // A malformed record fails the next call, after this batch.
+    if (not batch.empty()) {
+      stats::beginRecord();
+      return true;
+    }
+    if (size < 0) {
+      _error = EINVAL;
+      return false;
+    }
+
+    // Records of the batch are in the buffer, so only read more once they've
+    // been consumed.
+    if (not more(size)) {
+      return false;
+    }
+  }
+}
+
+// Reads more input, after making room for the whole of the next record, if
+// its size is known.
+bool Reader::more(ssize_t record_size) {
+  auto available = _end - _start;
+  if (record_size > 0 && (size_t)record_size > _buffer.size() - _start) {
+    memmove(_buffer.data(), _buffer.data() + _start, available);
+    _start = 0;
+    _end = available;
+    if ((size_t)record_size > _buffer.size()) {
+      stats::Timer timer{stats::Allocate};
+      stats::count(stats::Allocations);
+      _buffer.resize(record_size);
+    }
+  }
+
+  _error = 0;
+  if (not fill()) {
+    if (_error == 0 && _end != _start) {
+      // End of input in the middle of a record.
+      _error = EINVAL;
+    }
+    return false;
+  }
+  return true;
+}
+
+} // namespace knox
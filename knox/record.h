@@ -0,0 +1,158 @@
+#pragma once
+
+#include <bsm/libbsm.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace knox {
+
+class Sampler;
+struct RecordBatch;
+
+// A non-owning reference to a string inside of a record buffer. Unlike the
+// lengths stored in BSM tokens, `size` never includes a trailing NUL.
+struct StringRef {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  StringRef() = default;
+  StringRef(const char *data, size_t size) : data(data), size(size) {}
+  explicit StringRef(const char *string)
+      : data(string), size(string ? strlen(string) : 0) {}
+
+  bool empty() const { return size == 0; }
+  std::string str() const { return {data, size}; }
+
+  bool operator==(const StringRef &other) const {
+    return size == other.size && memcmp(data, other.data, size) == 0;
+  }
+  bool operator!=(const StringRef &other) const { return not(*this == other); }
+};
+
+// Iterates the tokens of a record with `au_fetch_tok`. Fetching a token does
+// not allocate, string fields in the token point into the record buffer.
+class TokenIterator {
+public:
+  TokenIterator(const u_char *cursor, size_t remaining)
+      : _cursor(cursor), _remaining(remaining) {
+    fetch();
+  }
+
+  const tokenstr_t &operator*() const { return _token; }
+  const tokenstr_t *operator->() const { return &_token; }
+
+  TokenIterator &operator++() {
+    _cursor += _token.len;
+    _remaining -= _token.len;
+    fetch();
+    return *this;
+  }
+
+  bool operator!=(const TokenIterator &other) const {
+    return _cursor != other._cursor;
+  }
+
+private:
+  void fetch();
+
+  const u_char *_cursor;
+  size_t _remaining;
+  tokenstr_t _token;
+};
+
+// A view of a single audit record, valid until the `Reader` that produced it
+// reads the next record. Move-only, to make accidental copies that outlive
+// the buffer stand out.
+class Record {
+public:
+  Record() = default;
+  Record(const u_char *data, size_t size) : _data(data), _size(size) {}
+
+  Record(Record &&) = default;
+  Record &operator=(Record &&) = default;
+  Record(const Record &) = delete;
+  Record &operator=(const Record &) = delete;
+
+  const u_char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+  // The event type from the header token, or 0 if the record has no header
+  // (for example the file tokens that begin and end a trail).
+  au_event_t event() const;
+
+  // The event time from the header token, in seconds and milliseconds. Returns
+  // false if the record has no header.
+  bool time(u_int64_t &seconds, u_int64_t &milliseconds) const;
+
+  TokenIterator begin() const { return {_data, _size}; }
+  TokenIterator end() const { return {_data + _size, 0}; }
+
+  // Fetches the first (or last) token of the given type.
+  bool find(u_char id, tokenstr_t &token) const;
+  bool findLast(u_char id, tokenstr_t &token) const;
+
+private:
+  const u_char *_data = nullptr;
+  size_t _size = 0;
+};
+
+// The size of the record starting at `data`, based on its leading header or
+// file token. Returns 0 if more than `size` bytes are needed to tell, and -1
+// if `data` does not start with a record.
+ssize_t recordSize(const u_char *data, size_t size);
+
+// Reads records from a file descriptor: an audit trail, a pipe, stdin, or
+// /dev/auditpipe. Records are read into a single reused buffer, so unlike
+// `au_read_rec` reading a record does not allocate.
+class Reader {
+public:
+  // When `owned`, the file descriptor is closed by the reader.
+  explicit Reader(int fd, bool owned = true, size_t buffer_size = 1 << 16);
+  ~Reader();
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  // Opens an audit trail file. Check `error()` for failure.
+  static Reader open(const char *path);
+
+  Reader(Reader &&other);
+  Reader &operator=(Reader &&other);
+
+  // Reads the next record into `record`, which remains valid until the next
+  // call. Returns false at the end of input, or on error.
+  bool next(Record &record);
+
+  // Reads the next batch of records: those that are already buffered, or
+  // else those of a single read. Records remain valid until the next call.
+  // Returns false at the end of input, or on error.
+  bool next(RecordBatch &batch);
+
+  // Records the sampler doesn't keep are skipped, right after being read.
+  void setSampler(Sampler *sampler) { _sampler = sampler; }
+
+  // With a timeout, `next` also returns false, with `error()` ETIMEDOUT, when
+  // no input arrives within it, and reading resumes with the next call. The
+  // default, -1, waits indefinitely.
+  void setTimeout(int milliseconds) { _timeout = milliseconds; }
+
+  // The errno of the last failure, or 0 at end of input.
+  int error() const { return _error; }
+  int fd() const { return _fd; }
+
+private:
+  bool fill();
+  bool more(ssize_t record_size);
+
+  int _fd;
+  bool _owned;
+  int _error = 0;
+  Sampler *_sampler = nullptr;
+  int _timeout = -1;
+  std::vector<u_char> _buffer;
+  size_t _start = 0;
+  size_t _end = 0;
+};
+
+} // namespace knox
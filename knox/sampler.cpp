@@ -0,0 +1,295 @@
+#include "sampler.h"
+#include "events.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <signal.h>
+
+namespace knox {
+
+static const size_t pid_buckets_count = 4096;
+
+// Pid buckets are found by probing this many slots from the hashed slot.
+static const size_t pid_probe_count = 4;
+
+// The murmur3 finalizer, to spread pids evenly.
+static u_int32_t hashPid(pid_t pid) {
+  u_int32_t hash = pid;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+static u_int32_t probabilityThreshold(double probability) {
+  // UINT32_MAX is reserved to mean keep everything.
+  if (probability >= 1) {
+    return UINT32_MAX;
+  }
+  return std::min(probability * 4294967296.0, UINT32_MAX - 1.0);
+}
+
+static bool parseProbability(const std::string &value, double &probability) {
+  char *end;
+  probability = strtod(value.c_str(), &end);
+  return not value.empty() && *end == '\0' && probability >= 0 &&
+         probability <= 1;
+}
+
+static bool parseRate(const std::string &value, double &per_second,
+                      double &burst) {
+  char *end;
+  per_second = strtod(value.c_str(), &end);
+  burst = per_second;
+  if (*end == '/') {
+    burst = strtod(end + 1, &end);
+  }
+  return not value.empty() && *end == '\0' && per_second > 0 && burst >= 1;
+}
+
+bool Sampler::configure(const std::string &spec, std::string &error) {
+  std::vector<AuditClass> classes;
+  std::vector<AuditEvent> events;
+
+  size_t start = 0;
+  while (start < spec.size()) {
+    auto end = spec.find(',', start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    auto item = spec.substr(start, end - start);
+    start = end + 1;
+
+    auto equals = item.find('=');
+    if (equals == std::string::npos) {
+      error = "expected <key>=<value>: " + item;
+      return false;
+    }
+    auto key = item.substr(0, equals);
+    auto value = item.substr(equals + 1);
+
+    if (key == "pid") {
+      if (not parseProbability(value, _pid_probability)) {
+        error = "invalid probability: " + item;
+        return false;
+      }
+      _sample_pids = true;
+      _pid_threshold = probabilityThreshold(_pid_probability);
+    } else if (key == "pid-rate") {
+      if (not parseRate(value, _pid_rate.per_second, _pid_rate.burst)) {
+        error = "invalid rate: " + item;
+        return false;
+      }
+      _pid_buckets.assign(pid_buckets_count, {});
+    } else if (key == "event-rate") {
+      if (not parseRate(value, _event_rate.per_second, _event_rate.burst)) {
+        error = "invalid rate: " + item;
+        return false;
+      }
+    } else {
+      if (classes.empty() && not loadAuditEvents(classes, events)) {
+        error = "could not read audit_class and audit_event";
+        return false;
+      }
+
+      ClassRule rule;
+      rule.name = key;
+      auto audit_class =
+          std::find_if(classes.begin(), classes.end(),
+                       [&](const AuditClass &c) { return c.name == key; });
+      if (audit_class == classes.end()) {
+        error = "unknown event class: " + key;
+        return false;
+      }
+      rule.mask = audit_class->mask;
+      if (not parseProbability(value, rule.probability)) {
+        error = "invalid probability: " + item;
+        return false;
+      }
+      rule.threshold = probabilityThreshold(rule.probability);
+      if (_class_rules.size() == UINT8_MAX) {
+        error = "too many event classes";
+        return false;
+      }
+      _class_rules.push_back(rule);
+    }
+  }
+
+  // Resolve the rule of each event up front, so that keep() is a lookup. An
+  // event in more than one sampled class gets the lowest probability.
+  if (not _class_rules.empty()) {
+    _event_rules.assign(UINT16_MAX + 1, 0);
+    for (auto &event : events) {
+      for (size_t i = 0; i < _class_rules.size(); ++i) {
+        auto &rule = _class_rules[i];
+        auto &index = _event_rules[event.number];
+        if ((event.mask & rule.mask) &&
+            (index == 0 ||
+             rule.probability < _class_rules[index - 1].probability)) {
+          index = i + 1;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+std::unique_ptr<Sampler> Sampler::fromEnvironment() {
+  auto spec = getenv("KNOX_SAMPLE");
+  if (not spec) {
+    return nullptr;
+  }
+
+  std::unique_ptr<Sampler> sampler{new Sampler};
+  std::string error;
+  if (not sampler->configure(spec, error)) {
+    fprintf(stderr, "error: invalid KNOX_SAMPLE: %s\n", error.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return sampler;
+}
+
+// xorshift64*, fast and good enough for sampling.
+u_int32_t Sampler::random() {
+  _state ^= _state >> 12;
+  _state ^= _state << 25;
+  _state ^= _state >> 27;
+  return (_state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+Sampler::PidBucket &Sampler::pidBucket(pid_t pid) {
+  // Probes a few slots, so that two busy pids that hash to the same slot
+  // don't keep resetting each other's bucket. When all are taken, the least
+  // recently used bucket is replaced.
+  const auto hash = hashPid(pid);
+  PidBucket *free = nullptr;
+  PidBucket *oldest = nullptr;
+  for (size_t i = 0; i < pid_probe_count; ++i) {
+    auto &slot = _pid_buckets[(hash + i) % _pid_buckets.size()];
+    if (slot.pid == pid) {
+      return slot;
+    }
+    if (slot.pid == 0) {
+      if (not free) {
+        free = &slot;
+      }
+    } else if (not oldest || slot.bucket.time < oldest->bucket.time) {
+      oldest = &slot;
+    }
+  }
+
+  auto &slot = free ? *free : *oldest;
+  slot = {pid, {}};
+  return slot;
+}
+
+bool Sampler::take(Bucket &bucket, const Rate &rate, u_int64_t time) {
+  if (bucket.tokens < 0) {
+    bucket.tokens = rate.burst;
+    bucket.time = time;
+  } else if (time > bucket.time) {
+    auto refill = (time - bucket.time) * rate.per_second / 1000;
+    bucket.tokens = std::min(rate.burst, bucket.tokens + refill);
+    bucket.time = time;
+  }
+
+  if (bucket.tokens < 1) {
+    return false;
+  }
+  bucket.tokens -= 1;
+  return true;
+}
+
+bool Sampler::keep(const Record &record) {
+  ++_seen;
+  const auto event = record.event();
+
+  if (not _event_rules.empty() && _event_rules[event] != 0) {
+    auto &rule = _class_rules[_event_rules[event] - 1];
+    ++rule.seen;
+    if (rule.threshold != UINT32_MAX && random() >= rule.threshold) {
+      return false;
+    }
+    ++rule.kept;
+  }
+
+  const bool pid_rate = not _pid_buckets.empty();
+  const bool event_rate = _event_rate.per_second > 0;
+  if (not _sample_pids && not pid_rate && not event_rate) {
+    ++_kept;
+    return true;
+  }
+
+  const auto pid = subjectPid(record);
+  if (_sample_pids && pid != 0 && _pid_threshold != UINT32_MAX &&
+      hashPid(pid) >= _pid_threshold) {
+    ++_pid_dropped;
+    return false;
+  }
+
+  u_int64_t seconds, milliseconds;
+  if ((pid_rate || event_rate) && record.time(seconds, milliseconds)) {
+    const auto time = seconds * 1000 + milliseconds;
+
+    if (pid_rate && pid != 0) {
+      auto &slot = pidBucket(pid);
+      if (not take(slot.bucket, _pid_rate, time)) {
+        ++_pid_rate_dropped;
+        return false;
+      }
+    }
+
+    if (event_rate && not take(_event_buckets[event], _event_rate, time)) {
+      ++_event_rate_dropped;
+      return false;
+    }
+  }
+
+  ++_kept;
+  return true;
+}
+
+void Sampler::report(FILE *file) const {
+  fprintf(file, "sampled: kept %llu of %llu records\n",
+          (unsigned long long)_kept, (unsigned long long)_seen);
+  for (auto &rule : _class_rules) {
+    fprintf(file, "  %s: kept %llu of %llu\n", rule.name.c_str(),
+            (unsigned long long)rule.kept, (unsigned long long)rule.seen);
+  }
+  if (_sample_pids) {
+    fprintf(file, "  pid: dropped %llu, scale by %g\n",
+            (unsigned long long)_pid_dropped,
+            _pid_probability > 0 ? 1 / _pid_probability : 0.0);
+  }
+  if (not _pid_buckets.empty()) {
+    fprintf(file, "  pid-rate: dropped %llu\n",
+            (unsigned long long)_pid_rate_dropped);
+  }
+  if (_event_rate.per_second > 0) {
+    fprintf(file, "  event-rate: dropped %llu\n",
+            (unsigned long long)_event_rate_dropped);
+  }
+}
+
+static volatile sig_atomic_t _interrupted = 0;
+
+static void interrupt(int signal) {
+  _interrupted = 1;
+  ::signal(signal, SIG_DFL);
+}
+
+void stopOnInterrupt() {
+  // Without SA_RESTART, so that a blocked read returns EINTR. This replaces
+  // the handlers of `--stats`, which then reports on exit.
+  struct sigaction act {};
+  act.sa_handler = interrupt;
+  sigaction(SIGINT, &act, nullptr);
+  sigaction(SIGTERM, &act, nullptr);
+}
+
+bool interrupted() { return _interrupted; }
+
+} // namespace knox
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "classes.h"
+#include "record.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace knox {
+
+// Drops records early, for event classes too voluminous to consume whole,
+// like `fr` and `fa` on a build host. A sampler is configured by a comma
+// separated spec of:
+//
+//   <class>=<probability>   keep events of the class with the probability
+//   pid=<probability>       keep all events of a deterministic, hash based,
+//                           sample of pids, so sampled processes are complete
+//   pid-rate=<n>[/<burst>]  keep at most n events per second per pid
+//   event-rate=<n>[/<burst>] keep at most n events per second per event type
+//
+// For example: "fr=0.01,fa=0.01,pid-rate=1000". Rates are based on record
+// times, so replays are limited the same as live events. Counters of kept
+// and dropped records are reported, to scale downstream totals back up.
+class Sampler {
+public:
+  // Returns false on an invalid spec, with the reason in `error`.
+  bool configure(const std::string &spec, std::string &error);
+
+  // The sampler configured by the KNOX_SAMPLE environment variable, or null
+  // if it's not set. Exits on an invalid spec.
+  static std::unique_ptr<Sampler> fromEnvironment();
+
+  // Whether to keep the record.
+  bool keep(const Record &record);
+
+  // Prints the counters, to scale totals back up.
+  void report(FILE *file) const;
+
+private:
+  struct ClassRule {
+    std::string name;
+    au_class_t mask;
+    double probability;
+    u_int32_t threshold;
+    u_int64_t seen = 0;
+    u_int64_t kept = 0;
+  };
+
+  struct Bucket {
+    double tokens = -1;
+    u_int64_t time = 0;
+  };
+
+  struct PidBucket {
+    pid_t pid = 0;
+    Bucket bucket;
+  };
+
+  struct Rate {
+    double per_second = 0;
+    double burst = 0;
+  };
+
+  PidBucket &pidBucket(pid_t pid);
+  bool take(Bucket &bucket, const Rate &rate, u_int64_t time);
+  u_int32_t random();
+
+  std::vector<ClassRule> _class_rules;
+  // The index + 1, into `_class_rules`, for each event number.
+  std::vector<u_char> _event_rules;
+
+  u_int32_t _pid_threshold = 0;
+  bool _sample_pids = false;
+  double _pid_probability = 1;
+
+  Rate _pid_rate;
+  Rate _event_rate;
+  // Per pid buckets, in a fixed size hash table so memory is constant.
+  std::vector<PidBucket> _pid_buckets;
+  std::unordered_map<au_event_t, Bucket> _event_buckets;
+
+  u_int64_t _state = 0x9e3779b97f4a7c15ull;
+
+  u_int64_t _seen = 0;
+  u_int64_t _kept = 0;
+  u_int64_t _pid_dropped = 0;
+  u_int64_t _pid_rate_dropped = 0;
+  u_int64_t _event_rate_dropped = 0;
+};
+
+// Makes the first SIGINT or SIGTERM interrupt a blocking read, rather than
+// terminate, so that a tool reading live events ends its read loop and still
+// reports its counters. A second one terminates. `interrupted` is whether one
+// was received, to tell the interrupted read from an error.
+void stopOnInterrupt();
+bool interrupted();
+
+} // namespace knox
@@ -0,0 +1,276 @@
+#include "spill.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace knox {
+
+// Allocates the file's blocks up to `size`, on top of those it has.
+static bool preallocate(int fd, u_int64_t size) {
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    return false;
+  }
+  if ((u_int64_t)status.st_size >= size) {
+    return true;
+  }
+
+#if defined(__APPLE__)
+  fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0,
+                 (off_t)(size - status.st_size), 0};
+  if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+    // Contiguous blocks are better, but not required.
+    store.fst_flags = F_ALLOCATEALL;
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+      return false;
+    }
+  }
+  return ftruncate(fd, size) == 0;
+#else
+  auto error = posix_fallocate(fd, status.st_size, size - status.st_size);
+  if (error != 0) {
+    errno = error;
+    return false;
+  }
+  return true;
+#endif
+}
+
+SpillRing::~SpillRing() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+bool SpillRing::open(const char *path, u_int64_t capacity) {
+  // Never an existing file, which could be someone's data. The file is
+  // unlinked right away, so it's removed on exit, even a crash, and the path
+  // can be used again.
+  auto fd = ::open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return false;
+  }
+  unlink(path);
+  if (not preallocate(fd, capacity)) {
+    auto error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  if (_fd >= 0) {
+    close(_fd);
+  }
+  _fd = fd;
+  _capacity = capacity;
+  _head = _size = 0;
+  return true;
+}
+
+bool SpillRing::append(const void *data, size_t size) {
+  if (size > available()) {
+    errno = ENOSPC;
+    return false;
+  }
+
+  auto bytes = (const char *)data;
+  auto remaining = size;
+  while (remaining > 0) {
+    // Up to the end of the file, then wrap around.
+    auto count = std::min<u_int64_t>(remaining, _capacity - _head);
+    auto written = pwrite(_fd, bytes, count, _head);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    remaining -= written;
+    _head = (_head + written) % _capacity;
+  }
+
+  _size += size;
+  _spilled += size;
+  _high_water = std::max(_high_water, _size);
+  return true;
+}
+
+ssize_t SpillRing::peek(void *data, size_t size) const {
+  auto bytes = (char *)data;
+  size = std::min<u_int64_t>(size, _size);
+  auto tail = (_head + _capacity - _size) % _capacity;
+  size_t copied = 0;
+  while (copied < size) {
+    auto count = std::min<u_int64_t>(size - copied, _capacity - tail);
+    auto read_size = pread(_fd, bytes + copied, count, tail);
+    if (read_size == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (read_size == 0) {
+      // The file was truncated by someone else.
+      errno = EIO;
+      return -1;
+    }
+    copied += read_size;
+    tail = (tail + read_size) % _capacity;
+  }
+  return copied;
+}
+
+void SpillRing::consume(size_t size) {
+  _size -= std::min<u_int64_t>(size, _size);
+}
+
+SpillWriter::SpillWriter(int fd, SpillRing &ring) : _fd(fd), _ring(ring) {
+  _flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, _flags | O_NONBLOCK);
+
+  // Signals, like SIGINT, are for the calling thread.
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+  _writer = std::thread{[this] { replay(); }};
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+SpillWriter::~SpillWriter() { finish(); }
+
+// Writes it all, waiting while the output would block.
+static bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    auto written = ::write(fd, data, size);
+    if (written == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        pollfd output{fd, POLLOUT, 0};
+        poll(&output, 1, -1);
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool SpillWriter::write(const void *data, size_t size) {
+  auto bytes = (const char *)data;
+
+  bool direct;
+  {
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (_error) {
+      errno = _error;
+      return false;
+    }
+    // Once anything is spilled, everything is, until the writer catches up,
+    // to keep the output in order.
+    direct = _ring.empty();
+  }
+
+  if (direct) {
+    while (size > 0) {
+      auto written = ::write(_fd, bytes, size);
+      if (written == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      bytes += written;
+      size -= written;
+    }
+    if (size == 0) {
+      return true;
+    }
+  }
+
+  if (size > _ring.capacity()) {
+    errno = EFBIG;
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock{_mutex};
+  if (_ring.available() < size) {
+    ++_full_count;
+    _space.wait(lock, [&] { return _ring.available() >= size || _error; });
+  }
+  if (_error) {
+    errno = _error;
+    return false;
+  }
+  if (not _ring.append(bytes, size)) {
+    return false;
+  }
+  _pending.notify_one();
+  return true;
+}
+
+void SpillWriter::replay() {
+  std::vector<char> chunk(1 << 16);
+  while (true) {
+    ssize_t size;
+    {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _pending.wait(lock, [this] { return not _ring.empty() || _closed; });
+      if (_ring.empty()) {
+        return;
+      }
+      size = _ring.peek(chunk.data(), chunk.size());
+      if (size == -1) {
+        _error = errno;
+        _space.notify_all();
+        return;
+      }
+    }
+
+    // The ring keeps the bytes until they're written, so that `write` keeps
+    // spilling, rather than writing ahead of them.
+    auto written = writeAll(_fd, chunk.data(), size);
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (not written) {
+      _error = errno;
+      _space.notify_all();
+      return;
+    }
+    _ring.consume(size);
+    _space.notify_one();
+  }
+}
+
+bool SpillWriter::finish() {
+  if (_writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock{_mutex};
+      _closed = true;
+      _pending.notify_one();
+    }
+    _writer.join();
+    fcntl(_fd, F_SETFL, _flags);
+  }
+
+  if (_error) {
+    errno = _error;
+    return false;
+  }
+  return true;
+}
+
+} // namespace knox
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+namespace knox {
+
+// A byte ring buffer in a preallocated file. Writes are sequential appends
+// at the head, wrapping at the end of the file, and reads are from the tail.
+// Not thread safe.
+class SpillRing {
+public:
+  SpillRing() = default;
+  ~SpillRing();
+
+  SpillRing(const SpillRing &) = delete;
+  SpillRing &operator=(const SpillRing &) = delete;
+
+  // Creates the file, readable only by its owner, and unlinks it, so that it
+  // lives only as long as the ring. Fails with EEXIST if the path exists.
+  // Allocates `capacity` bytes up front, so that spilling doesn't fail for
+  // lack of disk space. Returns false with errno set on failure.
+  bool open(const char *path, u_int64_t capacity);
+
+  // Returns false with errno set if the data doesn't fit (ENOSPC), or on
+  // failure.
+  bool append(const void *data, size_t size);
+
+  // Copies up to `size` of the oldest bytes, without removing them. Returns
+  // the number of bytes copied, or -1 with errno set.
+  ssize_t peek(void *data, size_t size) const;
+
+  // Removes the `size` oldest bytes.
+  void consume(size_t size);
+
+  bool empty() const { return _size == 0; }
+  u_int64_t size() const { return _size; }
+  u_int64_t capacity() const { return _capacity; }
+  u_int64_t available() const { return _capacity - _size; }
+
+  // The most bytes held at once, and the total bytes appended.
+  u_int64_t highWater() const { return _high_water; }
+  u_int64_t spilled() const { return _spilled; }
+
+private:
+  int _fd = -1;
+  u_int64_t _capacity = 0;
+  u_int64_t _head = 0;
+  u_int64_t _size = 0;
+  u_int64_t _high_water = 0;
+  u_int64_t _spilled = 0;
+};
+
+// Writes to an output, like stdout, without blocking on a stalled consumer.
+// What the output can't take right away is spilled to a `SpillRing`, which
+// a writer thread replays in order, once the consumer catches up. Only when
+// the ring is full does `write` block.
+class SpillWriter {
+public:
+  // The output is made non-blocking until `finish`.
+  SpillWriter(int fd, SpillRing &ring);
+  ~SpillWriter();
+
+  // Returns false with errno set if the output failed.
+  bool write(const void *data, size_t size);
+
+  // Waits for the spilled bytes to be written. Returns false with errno set
+  // if the output failed.
+  bool finish();
+
+  // The times `write` had to wait for room in the ring.
+  u_int64_t fullCount() const { return _full_count; }
+
+private:
+  void replay();
+
+  int _fd;
+  int _flags;
+  SpillRing &_ring;
+
+  std::mutex _mutex;
+  std::condition_variable _pending;
+  std::condition_variable _space;
+  bool _closed = false;
+  int _error = 0;
+  u_int64_t _full_count = 0;
+  std::thread _writer;
+};
+
+} // namespace knox
@@ -0,0 +1,196 @@
+#include "stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace knox {
+namespace stats {
+
+static bool _enabled = false;
+
+bool enabled() { return _enabled; }
+
+#if KNOX_STATS
+
+namespace detail {
+
+Totals totals;
+Timer *current = nullptr;
+
+} // namespace detail
+
+static u_int64_t _start_nanoseconds;
+static u_int64_t _start_cycles;
+
+// clock_gettime, unlike most of libc, is safe in a signal handler.
+static u_int64_t nanoseconds() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+namespace {
+
+// Formats into a fixed buffer without printf, which isn't safe in a signal
+// handler.
+class Formatter {
+public:
+  Formatter &operator<<(const char *string) {
+    while (*string && _size < sizeof(_buffer)) {
+      _buffer[_size++] = *string++;
+    }
+    return *this;
+  }
+
+  Formatter &operator<<(u_int64_t number) {
+    char digits[20];
+    int count = 0;
+    do {
+      digits[count++] = '0' + number % 10;
+      number /= 10;
+    } while (number > 0);
+    while (count > 0 && _size < sizeof(_buffer)) {
+      _buffer[_size++] = digits[--count];
+    }
+    return *this;
+  }
+
+  // Milliseconds, with 3 decimals.
+  Formatter &milliseconds(u_int64_t nanoseconds) {
+    auto microseconds = nanoseconds / 1000;
+    *this << microseconds / 1000 << ".";
+    auto fraction = microseconds % 1000;
+    *this << (fraction < 100 ? "0" : "") << (fraction < 10 ? "0" : "")
+          << fraction << "ms";
+    return *this;
+  }
+
+  void write(int fd) const {
+    size_t written = 0;
+    while (written < _size) {
+      auto size = ::write(fd, _buffer + written, _size - written);
+      if (size <= 0) {
+        return;
+      }
+      written += size;
+    }
+  }
+
+private:
+  char _buffer[4096];
+  size_t _size = 0;
+};
+
+} // namespace
+
+void report(int fd) {
+  static const char *stage_names[] = {"read", "allocate", "decode", "match",
+                                      "output"};
+  auto &totals = detail::totals;
+
+  // Cycles to nanoseconds, from the cycles and time since init.
+  auto elapsed_nanoseconds = nanoseconds() - _start_nanoseconds;
+  auto elapsed_cycles = cycles() - _start_cycles;
+  auto toNanoseconds = [&](u_int64_t count) -> u_int64_t {
+    if (elapsed_cycles == 0) {
+      return 0;
+    }
+    return (double)count * elapsed_nanoseconds / elapsed_cycles;
+  };
+
+  Formatter output;
+  output << "\nstats: " << totals.counters[Records] << " records, "
+         << totals.counters[Tokens] << " tokens, " << totals.counters[Bytes]
+         << " bytes, " << totals.counters[Allocations] << " allocations in ";
+  output.milliseconds(elapsed_nanoseconds) << "\n";
+
+  for (int stage = 0; stage < StageCount; ++stage) {
+    auto calls = totals.calls[stage];
+    if (calls == 0) {
+      continue;
+    }
+    auto stage_cycles = totals.cycles[stage];
+    output << "  " << stage_names[stage] << ": " << calls << " calls, "
+           << stage_cycles << " cycles (" << stage_cycles / calls
+           << "/call), ";
+    output.milliseconds(toNanoseconds(stage_cycles)) << "\n";
+  }
+
+  bool header = false;
+  for (int bucket = 0; bucket < 64; ++bucket) {
+    if (totals.latency[bucket] == 0) {
+      continue;
+    }
+    if (not header) {
+      output << "  cycles per record:\n";
+      header = true;
+    }
+    u_int64_t low = bucket == 0 ? 0 : 1ull << bucket;
+    u_int64_t high = (1ull << bucket) * 2 - 1;
+    output << "    " << low << "-" << high << " (~" << toNanoseconds(low)
+           << "ns): " << totals.latency[bucket] << "\n";
+  }
+
+  output.write(fd);
+}
+
+static void reportOnExit() { report(STDERR_FILENO); }
+
+static void reportOnSignal(int signal) {
+  report(STDERR_FILENO);
+  if (signal != SIGUSR1) {
+    // Terminate, as if this handler wasn't installed.
+    ::signal(signal, SIG_DFL);
+    raise(signal);
+  }
+}
+
+void init(int &argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(*argv));
+      --argc;
+      _enabled = true;
+      break;
+    }
+  }
+  if (not _enabled) {
+    return;
+  }
+
+  _start_nanoseconds = nanoseconds();
+  _start_cycles = cycles();
+  atexit(reportOnExit);
+
+  // Tools that handle SIGINT themselves, to exit cleanly, replace this, and
+  // report on exit instead.
+  struct sigaction act {};
+  act.sa_handler = reportOnSignal;
+  sigaction(SIGINT, &act, nullptr);
+  sigaction(SIGTERM, &act, nullptr);
+  // Restart interrupted reads, which some tools take as a request to stop.
+  act.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &act, nullptr);
+}
+
+#else
+
+void report(int fd) {}
+
+void init(int &argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      fprintf(stderr, "error: --stats requires building with `make STATS=1`\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+#endif
+
+} // namespace stats
+} // namespace knox
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <sys/types.h>
+
+#if KNOX_STATS
+#include <time.h>
+#endif
+
+// Hot path instrumentation, compiled in with `make STATS=1`, which defines
+// KNOX_STATS. Otherwise timers and counters are empty inline functions, and
+// cost nothing.
+//
+// Time is measured in cycles of the CPU's cycle counter, per stage of the
+// pipeline. Nested timers are exclusive, for example the time of an output
+// timer within a match timer counts only as output. The report, printed on
+// exit or SIGUSR1, converts cycles to time by calibrating against the clock.
+namespace knox {
+namespace stats {
+
+enum Stage { Read, Allocate, Decode, Match, Output, StageCount };
+enum Counter { Records, Tokens, Bytes, Allocations, CounterCount };
+
+// Removes a `--stats` argument, and if there was one, reports stats on exit,
+// SIGINT, SIGTERM and SIGUSR1. Exits if `--stats` is given, but stats were
+// not compiled in. Call first thing in main.
+void init(int &argc, char **argv);
+
+// Whether `--stats` was given, for example to pass it on when re-executing.
+bool enabled();
+
+#if KNOX_STATS
+
+inline u_int64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  // The generic timer, which ticks at a fixed rate, for example 24MHz on
+  // Apple silicon, so short stages round to zero.
+  u_int64_t value;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+  return value;
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+class Timer;
+
+namespace detail {
+
+struct Totals {
+  u_int64_t cycles[StageCount];
+  u_int64_t calls[StageCount];
+  u_int64_t counters[CounterCount];
+  // Log2 buckets of the cycles spent on each record.
+  u_int64_t latency[64];
+  u_int64_t record_start;
+};
+
+extern Totals totals;
+extern Timer *current;
+
+} // namespace detail
+
+// Times a stage, from construction to destruction.
+class Timer {
+public:
+  explicit Timer(Stage stage)
+      : _stage(stage), _parent(detail::current), _start(cycles()) {
+    detail::current = this;
+  }
+
+  ~Timer() {
+    auto elapsed = cycles() - _start;
+    detail::totals.cycles[_stage] += elapsed - _nested;
+    ++detail::totals.calls[_stage];
+    if (_parent) {
+      _parent->_nested += elapsed;
+    }
+    detail::current = _parent;
+  }
+
+  Timer(const Timer &) = delete;
+  Timer &operator=(const Timer &) = delete;
+
+private:
+  Stage _stage;
+  Timer *_parent;
+  u_int64_t _start;
+  u_int64_t _nested = 0;
+};
+
+inline void count(Counter counter, u_int64_t value = 1) {
+  detail::totals.counters[counter] += value;
+}
+
+// Marks the start and end of the processing of a record, for the latency
+// histogram. Called by Reader::next.
+inline void beginRecord() { detail::totals.record_start = cycles(); }
+
+inline void endRecord() {
+  auto &totals = detail::totals;
+  if (totals.record_start == 0) {
+    return;
+  }
+  auto elapsed = cycles() - totals.record_start;
+  ++totals.latency[63 - __builtin_clzll(elapsed | 1)];
+  totals.record_start = 0;
+}
+
+// Ends a batch of `count` records, begun with `beginRecord`, as that many
+// records of the batch's average latency.
+inline void endRecords(size_t count) {
+  auto &totals = detail::totals;
+  if (totals.record_start == 0 || count == 0) {
+    return;
+  }
+  auto elapsed = (cycles() - totals.record_start) / count;
+  totals.latency[63 - __builtin_clzll(elapsed | 1)] += count;
+  totals.record_start = 0;
+}
+
+#else
+
+class Timer {
+public:
+  explicit Timer(Stage) {}
+};
+
+inline void count(Counter, u_int64_t = 1) {}
+inline void beginRecord() {}
+inline void endRecord() {}
+inline void endRecords(size_t count) {}
+
+#endif
+
+// Prints the stats, safely from a signal handler.
+void report(int fd);
+
+} // namespace stats
+} // namespace knox
@@ -0,0 +1,93 @@
+#include "tokens.h"
+
+namespace knox {
+
+static size_t read16(const u_char *data) { return data[0] << 8 | data[1]; }
+
+static size_t read32(const u_char *data) {
+  return (size_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+// The size of a token that ends with an IPv4 or IPv6 address, given the
+// offset of its address type.
+static size_t addressTokenSize(const u_char *data, size_t size,
+                               size_t type_offset, size_t fixed_size) {
+  if (size < type_offset + 4) {
+    return 0;
+  }
+  auto address_size = read32(data + type_offset);
+  if (address_size != 4 && address_size != 16) {
+    return 0;
+  }
+  return fixed_size + address_size;
+}
+
+// The size of a token with a 16 bit length at `length_offset`, followed by
+// that many bytes.
+static size_t lengthTokenSize(const u_char *data, size_t size,
+                              size_t length_offset) {
+  if (size < length_offset + 2) {
+    return 0;
+  }
+  return length_offset + 2 + read16(data + length_offset);
+}
+
+size_t variableTokenSize(const u_char *data, size_t size) {
+  switch (data[0]) {
+  case AUT_PATH:
+  case AUT_TEXT:
+  case AUT_OPAQUE:
+  case AUT_ZONENAME:
+    return lengthTokenSize(data, size, 1);
+  case AUT_ARG32:
+    // id, argument number (1), value (4), length.
+    return lengthTokenSize(data, size, 6);
+  case AUT_ARG64:
+    // id, argument number (1), value (8), length.
+    return lengthTokenSize(data, size, 10);
+  case AUT_OTHER_FILE32:
+    // id, seconds (4), milliseconds (4), length.
+    return lengthTokenSize(data, size, 9);
+  case AUT_NEWGROUPS:
+  case AUT_GROUPS:
+    // id, count (2), groups (4 each).
+    return size < 3 ? 0 : 3 + 4 * read16(data + 1);
+  case AUT_EXEC_ARGS:
+  case AUT_EXEC_ENV: {
+    // id, count (4), then NUL terminated strings.
+    if (size < 5) {
+      return 0;
+    }
+    auto count = read32(data + 1);
+    size_t offset = 5;
+    for (size_t i = 0; i < count; ++i) {
+      auto end = (const u_char *)memchr(data + offset, '\0', size - offset);
+      if (not end) {
+        return 0;
+      }
+      offset = end - data + 1;
+    }
+    return offset;
+  }
+  case AUT_HEADER32_EX:
+    // id, size (4), version (1), event type (2), modifier (2), address type
+    // (4), address, seconds (4), milliseconds (4).
+    return addressTokenSize(data, size, 10, 22);
+  case AUT_HEADER64_EX:
+    return addressTokenSize(data, size, 10, 30);
+  case AUT_SUBJECT32_EX:
+  case AUT_PROCESS32_EX:
+    // id, ids and pid (28), terminal port (4), address type (4), address.
+    return addressTokenSize(data, size, 33, 37);
+  case AUT_SUBJECT64_EX:
+  case AUT_PROCESS64_EX:
+    // id, ids and pid (28), terminal port (8), address type (4), address.
+    return addressTokenSize(data, size, 37, 41);
+  case AUT_IN_ADDR_EX:
+    return addressTokenSize(data, size, 1, 5);
+  default:
+    return 0;
+  }
+}
+
+} // namespace knox
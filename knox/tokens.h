@@ -0,0 +1,181 @@
+#pragma once
+
+#include "record.h"
+#include "stats.h"
+
+#include <type_traits>
+
+namespace knox {
+
+namespace detail {
+
+struct TokenTable {
+  u_char values[256];
+};
+
+// The total size, including the id byte, of tokens that have a fixed size.
+// Zero for tokens with a variable size.
+constexpr TokenTable makeFixedTokenSizes() {
+  TokenTable table{};
+  table.values[AUT_TRAILER] = 7;
+  table.values[AUT_HEADER32] = 18;
+  table.values[AUT_HEADER64] = 26;
+  table.values[AUT_IPC] = 6;
+  table.values[AUT_SUBJECT32] = 37;
+  table.values[AUT_PROCESS32] = 37;
+  table.values[AUT_RETURN32] = 6;
+  table.values[AUT_IN_ADDR] = 5;
+  table.values[AUT_IP] = 21;
+  table.values[AUT_IPORT] = 3;
+  table.values[AUT_SOCKET] = 15;
+  table.values[AUT_SEQ] = 5;
+  table.values[AUT_ATTR] = 29;
+  table.values[AUT_IPC_PERM] = 29;
+  table.values[AUT_ATTR32] = 29;
+  table.values[AUT_EXIT] = 9;
+  table.values[AUT_RETURN64] = 10;
+  table.values[AUT_ATTR64] = 33;
+  table.values[AUT_SUBJECT64] = 41;
+  table.values[AUT_PROCESS64] = 41;
+  table.values[AUT_SOCKINET32] = 9;
+  table.values[AUT_SOCKINET128] = 21;
+  return table;
+}
+
+// The 1-based position of each token id in `ids`, and 0 for other ids.
+template <typename... Ids> constexpr TokenTable makeTokenIndex(Ids... ids) {
+  TokenTable table{};
+  const u_char list[] = {0, (u_char)ids...};
+  for (size_t i = 1; i < sizeof(list); ++i) {
+    table.values[list[i]] = i;
+  }
+  return table;
+}
+
+// A class template, so that the table has a single definition.
+template <typename = void> struct FixedTokenSizes {
+  static constexpr TokenTable table = makeFixedTokenSizes();
+};
+
+template <typename T>
+constexpr TokenTable FixedTokenSizes<T>::table;
+
+} // namespace detail
+
+// The size of a variable sized token, from its length fields. Returns 0 for
+// tokens it doesn't know, or if the token is truncated.
+size_t variableTokenSize(const u_char *data, size_t size);
+
+// The size of the token at `data`, without decoding it. Falls back to
+// `au_fetch_tok` for token types without a fast path. Returns 0 if the token
+// is malformed.
+inline size_t tokenSize(const u_char *data, size_t size) {
+  size_t token_size = detail::FixedTokenSizes<>::table.values[data[0]];
+  if (token_size == 0) {
+    token_size = variableTokenSize(data, size);
+  }
+  if (token_size == 0) {
+    tokenstr_t token;
+    if (au_fetch_tok(&token, (u_char *)data, (int)size) == 0) {
+      token_size = token.len;
+    }
+  }
+  return token_size <= size ? token_size : 0;
+}
+
+template <u_char Id> using TokenTag = std::integral_constant<u_char, Id>;
+
+// A token scanner specialized, at compile time, for the token types a tool
+// consumes. Other tokens are skipped by their size without being decoded, and
+// only the wanted tokens are decoded and passed to the handler.
+//
+// The handler is called as `handler(TokenTag<Id>{}, token)`, so that
+// overloads for each token type are resolved, and inlined, at compile time.
+// Handlers return false to stop scanning.
+//
+//     knox::TokenScanner<AUT_EXEC_ARGS, AUT_PATH>::scan(record, handler);
+template <u_char... Ids> class TokenScanner {
+public:
+  // Returns false if the record is malformed.
+  template <typename Handler>
+  static bool scan(const Record &record, Handler &&handler) {
+    auto cursor = record.data();
+    auto remaining = record.size();
+    tokenstr_t token;
+    stats::Timer timer{stats::Decode};
+    while (remaining > 0) {
+      if (index.values[*cursor]) {
+        stats::count(stats::Tokens);
+        if (au_fetch_tok(&token, (u_char *)cursor, (int)remaining) != 0 ||
+            token.len == 0 || token.len > remaining) {
+          return false;
+        }
+        if (not dispatch(handler, token)) {
+          return true;
+        }
+        cursor += token.len;
+        remaining -= token.len;
+      } else {
+        auto size = tokenSize(cursor, remaining);
+        if (size == 0) {
+          return false;
+        }
+        cursor += size;
+        remaining -= size;
+      }
+    }
+    return true;
+  }
+
+private:
+  static constexpr detail::TokenTable index = detail::makeTokenIndex(Ids...);
+
+  template <u_char Id, typename Handler>
+  static bool call(Handler &handler, const tokenstr_t &token) {
+    return handler(TokenTag<Id>{}, token);
+  }
+
+  // A jump table, indexed by the position of the token id in `Ids`.
+  template <typename Handler>
+  static bool dispatch(Handler &handler, const tokenstr_t &token) {
+    using Call = bool (*)(Handler &, const tokenstr_t &);
+    static constexpr Call calls[] = {nullptr, &call<Ids, Handler>...};
+    return calls[index.values[token.id]](handler, token);
+  }
+};
+
+template <u_char... Ids>
+constexpr detail::TokenTable TokenScanner<Ids...>::index;
+
+// The token types that identify a process, and their pid.
+using ProcessTokenScanner =
+    TokenScanner<AUT_PROCESS32, AUT_PROCESS32_EX, AUT_PROCESS64,
+                 AUT_PROCESS64_EX, AUT_SUBJECT32, AUT_SUBJECT32_EX,
+                 AUT_SUBJECT64, AUT_SUBJECT64_EX>;
+
+inline pid_t tokenPid(TokenTag<AUT_PROCESS32>, const tokenstr_t &token) {
+  return token.tt.proc32.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_PROCESS32_EX>, const tokenstr_t &token) {
+  return token.tt.proc32_ex.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_PROCESS64>, const tokenstr_t &token) {
+  return token.tt.proc64.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_PROCESS64_EX>, const tokenstr_t &token) {
+  return token.tt.proc64_ex.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_SUBJECT32>, const tokenstr_t &token) {
+  return token.tt.subj32.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_SUBJECT32_EX>, const tokenstr_t &token) {
+  return token.tt.subj32_ex.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_SUBJECT64>, const tokenstr_t &token) {
+  return token.tt.subj64.pid;
+}
+inline pid_t tokenPid(TokenTag<AUT_SUBJECT64_EX>, const tokenstr_t &token) {
+  return token.tt.subj64_ex.pid;
+}
+
+} // namespace knox
@@ -1,140 +1,242 @@
-#include <bsm/libbsm.h>
-#include <libgen.h>
+#include "knox/events.h"
+#include "knox/processes.h"
+#include "knox/sampler.h"
+#include "knox/stats.h"
+#include "knox/tokens.h"
+
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
 #include <string>
-#include <sys/sysctl.h>
 #include <unistd.h>
-#include <unordered_map>
 #include <unordered_set>
-#include <vector>
-
-static pid_t
-_childPid(const std::unordered_multimap<u_char, tokenstr_t> &tokens) {
-  // For posix_spawn, the subject pid is the parent process. The child pid comes
-  // from one of the arg token named "child PID".
-  auto range = tokens.equal_range(AUT_ARG32);
-  for (auto it = range.first; it != range.second; ++it) {
-    auto &arg = it->second.tt.arg32;
-    if (arg.len > 0 && strcmp(arg.text, "child PID") == 0) {
-      return arg.val;
+
+// The tokens paudit consumes, gathered by a single scan of each record.
+struct RecordTokens {
+  // Records have at most a couple of process and subject tokens.
+  pid_t pids[8];
+  int pids_count = 0;
+  pid_t subject_pid = 0;
+  knox::StringRef command;
+  pid_t child_pid = 0;
+
+  template <u_char Id>
+  bool operator()(knox::TokenTag<Id> tag, const tokenstr_t &token) {
+    auto pid = knox::tokenPid(tag, token);
+    if (pids_count < 8) {
+      pids[pids_count++] = pid;
     }
+    if (Id == AUT_SUBJECT32 || Id == AUT_SUBJECT32_EX || Id == AUT_SUBJECT64 ||
+        Id == AUT_SUBJECT64_EX) {
+      subject_pid = pid;
+    }
+    return true;
   }
 
-  return 0;
-}
-
-static std::vector<pid_t>
-_eventPids(const std::unordered_multimap<u_char, tokenstr_t> &tokens) {
-  std::vector<pid_t> pids;
-
-  {
-    auto range = tokens.equal_range(AUT_PROCESS32);
-    for (auto it = range.first; it != range.second; ++it) {
-      pids.push_back(it->second.tt.proc32.pid);
+  bool operator()(knox::TokenTag<AUT_EXEC_ARGS>, const tokenstr_t &token) {
+    if (token.tt.execarg.count > 0) {
+      command = knox::commandName(token.tt.execarg.text[0]);
     }
+    return true;
   }
 
-  {
-    auto range = tokens.equal_range(AUT_SUBJECT32);
-    for (auto it = range.first; it != range.second; ++it) {
-      pids.push_back(it->second.tt.subj32.pid);
+  bool operator()(knox::TokenTag<AUT_ARG32>, const tokenstr_t &token) {
+    // For posix_spawn, the subject pid is the parent process. The child pid
+    // comes from one of the arg token named "child PID".
+    auto &arg = token.tt.arg32;
+    if (arg.len > 0 && strcmp(arg.text, "child PID") == 0) {
+      child_pid = arg.val;
     }
+    return true;
   }
+};
+
+using RecordScanner =
+    knox::TokenScanner<AUT_PROCESS32, AUT_PROCESS32_EX, AUT_PROCESS64,
+                       AUT_PROCESS64_EX, AUT_SUBJECT32, AUT_SUBJECT32_EX,
+                       AUT_SUBJECT64, AUT_SUBJECT64_EX, AUT_EXEC_ARGS,
+                       AUT_ARG32>;
+
+// The state paudit keeps for each process.
+struct ProcessState {
+  bool watched;
+  // The record time the pid was last checked to still be this process.
+  u_int64_t checked;
+};
+
+using ProcessEntry = knox::ProcessCache<ProcessState>::Entry;
+
+// Records are timed as their syscall starts, so a forked child starts a little
+// after the time of its fork record.
+static const u_int64_t start_slack = 1000;
+
+// Whether the pid of a cached process now belongs to another process. Entries
+// are erased on exit, but the exit can be missed, when `pc` isn't preselected
+// or the record was dropped. Then a recycled pid would keep the verdict of the
+// process before it. A process that started after it was first seen, and
+// before the record, is another process. A check is a syscall, so a process
+// is re-checked at most once an `interval`, in milliseconds of record time,
+// or never when it's 0.
+static bool isRecycled(ProcessEntry &process, u_int64_t time,
+                       u_int64_t interval) {
+  if (interval == 0 || time < process.state.checked + interval) {
+    return false;
+  }
+  process.state.checked = time;
+  auto start_time = knox::processStartTime(process.pid);
+  return start_time > process.generation + start_slack && start_time <= time;
+}
 
-  return pids;
+static auto usage() {
+  fprintf(stderr,
+          "usage: paudit [-n <processes>] [-c <seconds>] <command>...\n"
+          "\n"
+          "  -n  the most processes tracked at once (default 65536)\n"
+          "  -c  re-check a pid's process at most this often, in seconds, in\n"
+          "      case its exit was missed, or 0 for never (default 60)\n");
+  return EXIT_FAILURE;
 }
 
-static char *_pidExecPath(pid_t pid) {
-  int argmax_mib[] = {CTL_KERN, KERN_ARGMAX};
-  int argmax = ARG_MAX;
-  auto argmax_size = sizeof(size_t);
-  if (sysctl(argmax_mib, 2, &argmax, &argmax_size, NULL, 0) != 0) {
-    return nullptr;
+int main(int argc, char **argv) {
+  knox::stats::init(argc, argv);
+
+  // Enough for the processes of a busy host, each entry is a few bytes.
+  size_t capacity = 1 << 16;
+  u_int64_t recheck_interval = 60 * 1000;
+
+  int option;
+  while ((option = getopt(argc, argv, "n:c:h")) != -1) {
+    switch (option) {
+    case 'n':
+      capacity = strtoul(optarg, nullptr, 10);
+      if (capacity == 0) {
+        return usage();
+      }
+      break;
+    case 'c':
+      recheck_interval = strtoull(optarg, nullptr, 10) * 1000;
+      break;
+    default:
+      return usage();
+    }
   }
 
-  char *procargs = (char *)malloc(argmax);
-
-  int procargs_mib[] = {CTL_KERN, KERN_PROCARGS2, pid};
-  size_t procargs_size = argmax;
-  if (sysctl(procargs_mib, 3, procargs, &procargs_size, NULL, 0) != 0) {
-    // Can happen if the pid is already gone.
-    return nullptr;
+  if (optind == argc) {
+    return usage();
   }
 
-  // Skip past argc count.
-  procargs += sizeof(int);
-  auto *exec_path = procargs;
+  std::unordered_set<std::string> watchedCommands{argv + optind, argv + argc};
+  // Entries are erased on exit, and replaced on fork and exec, so that a
+  // recycled pid starts over.
+  knox::ProcessCache<ProcessState> processes{capacity};
+
+  // Know the existing processes up front, rather than looking each up when
+  // first seen, which fails if it has already exited.
+  auto start = std::chrono::steady_clock::now();
+  std::vector<knox::ProcessInfo> table;
+  if (knox::listProcesses(table)) {
+    // A process is watched by the command it runs, like after startup,
+    // where a forked child inherits its parent's verdict, and an exec
+    // replaces it. A child that was forked and didn't exec runs its parent's
+    // command, so there's no need to walk the parent links.
+    for (auto &process : table) {
+      auto command_watched =
+          watchedCommands.find(process.command) != watchedCommands.end();
+      processes.insert(process.pid, process.start_time,
+                       {command_watched, process.start_time});
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "paudit: loaded %zu processes in %.1fms\n", table.size(),
+            elapsed.count());
+  } else {
+    perror("warning: could not list processes");
+  }
 
-  return exec_path;
-}
+  knox::Reader input{STDIN_FILENO, false};
 
-int main(int argc, char **argv) {
-  std::unordered_set<std::string> watchedCommands{argv + 1, argv + argc};
-  std::unordered_set<pid_t> watchedPids{};
-  std::unordered_set<pid_t> ignoredPids{};
-
-  std::unordered_multimap<u_char, tokenstr_t> tokens;
-  auto input = stdin;
-  while (feof(input) == 0) {
-    u_char *buffer = nullptr;
-    auto record_size = au_read_rec(input, &buffer);
-    if (record_size == 0) {
-      break;
+  // Sample as configured by KNOX_SAMPLE, for example "fr=0.01,pid-rate=100".
+  auto sampler = knox::Sampler::fromEnvironment();
+  input.setSampler(sampler.get());
+  if (sampler) {
+    knox::stopOnInterrupt();
+  }
+  knox::Record record;
+  while (not knox::interrupted() && input.next(record)) {
+    RecordTokens tokens;
+    if (not RecordScanner::scan(record, tokens)) {
+      continue;
     }
 
-    auto cursor = buffer;
-    auto remaining = record_size;
-    tokens.clear();
-    while (remaining > 0) {
-      tokenstr_t token;
-      au_fetch_tok(&token, cursor, remaining);
-      tokens.emplace(token.id, token);
-      remaining -= token.len;
-      cursor += token.len;
+    u_int64_t seconds, milliseconds;
+    u_int64_t time = 0;
+    if (record.time(seconds, milliseconds)) {
+      time = seconds * 1000 + milliseconds;
     }
 
+    knox::stats::Timer match_timer{knox::stats::Match};
     bool watched = false;
-    for (auto pid : _eventPids(tokens)) {
-      if (watchedPids.find(pid) != watchedPids.end()) {
-        watched = true;
-      }
-      else if (ignoredPids.find(pid) == ignoredPids.end()) {
-        auto exec_path = _pidExecPath(pid);
-        if (not exec_path) {
-          // No exec_path can mean that the process no longer exists.
-          // TODO: Lookup existing pids at start, so that they're already known.
+    for (int i = 0; i < tokens.pids_count; ++i) {
+      auto pid = tokens.pids[i];
+      if (auto process = processes.find(pid)) {
+        if (not isRecycled(*process, time, recheck_interval)) {
+          watched = watched || process->state.watched;
           continue;
         }
+        processes.erase(pid);
+      }
 
-        auto command = basename(exec_path);
-        if (watchedCommands.find(command) != watchedCommands.end()) {
-          watched = true;
-          watchedPids.insert(pid);
-        } else {
-          ignoredPids.insert(pid);
-        }
+      auto exec_path = knox::processPath(pid);
+      if (exec_path.empty()) {
+        // No exec_path means that the process no longer exists, it started
+        // and exited after the process table was read.
+        continue;
       }
+
+      auto command = knox::commandName(exec_path.c_str()).str();
+      auto command_watched =
+          watchedCommands.find(command) != watchedCommands.end();
+      processes.insert(pid, time, {command_watched, time});
+      watched = watched || command_watched;
     }
 
-    auto range = tokens.equal_range(AUT_EXEC_ARGS);
-    for (auto it = range.first; it != range.second; ++it) {
-      auto &exec_args = it->second.tt.execarg;
-      auto command = basename(exec_args.text[0]);
-      if (watchedCommands.find(command) != watchedCommands.end()) {
-        watched = true;
-        auto pid = _childPid(tokens);
-        if (pid != 0) {
-          watchedPids.insert(_childPid(tokens));
-        }
+    if (not tokens.command.empty()) {
+      // An exec, or a posix_spawn, starts a new generation of the process.
+      auto command_watched = watchedCommands.find(tokens.command.str()) !=
+                             watchedCommands.end();
+      watched = watched || command_watched;
+      auto pid = tokens.child_pid != 0 ? tokens.child_pid : tokens.subject_pid;
+      if (pid != 0) {
+        processes.insert(pid, time, {command_watched, time});
+      }
+    } else if (tokens.child_pid != 0) {
+      // A fork, the child runs the same command as its parent. Unless the
+      // child's own records came first, and it's already known.
+      auto parent = processes.find(tokens.subject_pid);
+      if (parent && not processes.find(tokens.child_pid, time)) {
+        processes.insert(tokens.child_pid, time,
+                         {parent->state.watched, time});
       }
     }
 
     if (watched) {
-      write(STDOUT_FILENO, buffer, record_size);
+      knox::stats::Timer timer{knox::stats::Output};
+      write(STDOUT_FILENO, record.data(), record.size());
+    }
+
+    if (knox::ProcessEvent{record}.isExit()) {
+      processes.erase(tokens.subject_pid);
     }
+  }
+
+  if (processes.evictions() > 0) {
+    fprintf(stderr, "warning: evicted %llu processes, consider a larger -n\n",
+            (unsigned long long)processes.evictions());
+  }
 
-    free(buffer);
+  if (sampler) {
+    sampler->report(stderr);
   }
 
   return 0;
@@ -0,0 +1,98 @@
+// Checks the audit_class and audit_event parsers, and the profile mappings of
+// `auditon profile`, against the files in test/fixtures.
+//
+// usage: test/classes [<fixtures-dir>]
+
+#include "knox/classes.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(CONDITION)                                                       \
+  if (not(CONDITION)) {                                                        \
+    fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #CONDITION);     \
+    ++failures;                                                                \
+  }
+
+static FILE *openFixture(const std::string &directory, const char *name) {
+  auto path = directory + "/" + name;
+  auto file = fopen(path.c_str(), "r");
+  if (not file) {
+    perror(path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return file;
+}
+
+int main(int argc, char **argv) {
+  const std::string directory = argc > 1 ? argv[1] : "test/fixtures";
+
+  std::vector<knox::AuditClass> classes;
+  auto class_file = openFixture(directory, "audit_class");
+  CHECK(knox::parseAuditClasses(class_file, classes));
+  fclose(class_file);
+  CHECK(classes.size() == 6);
+  CHECK(classes[1].mask == 0x1 && classes[1].name == "fr");
+  CHECK(classes[4].mask == 0x40000000 && classes[4].name == "ex");
+  CHECK(classes[5].mask == 0xffffffff && classes[5].name == "all");
+
+  // AUE_OPEN_RC has an unknown class, fc, which is skipped.
+  std::vector<knox::AuditEvent> events;
+  auto event_file = openFixture(directory, "audit_event");
+  CHECK(knox::parseAuditEvents(event_file, classes, events));
+  fclose(event_file);
+  CHECK(events.size() == 7);
+  auto execve = knox::findAuditEvent(events, "AUE_EXECVE");
+  CHECK(execve && execve->number == 23 && execve->mask == 0x40000080);
+  auto open_rc = knox::findAuditEvent(events, "AUE_OPEN_RC");
+  CHECK(open_rc && open_rc->mask == 0x1);
+  CHECK(not knox::findAuditEvent(events, "AUE_CLOSE"));
+
+  auto ex = knox::findAuditClass(classes, 0x40000000);
+  CHECK(ex && ex->name == "ex");
+  CHECK(not knox::findAuditClass(classes, 0x4));
+
+  // The lowest bit that's neither a class, nor an event's. The "all" class
+  // doesn't count.
+  auto class_bit = knox::unusedClassBit(classes, events);
+  CHECK(class_bit == 0x4);
+
+  std::vector<au_evclass_map_t> mappings;
+  std::string unknown;
+  CHECK(not knox::profileMappings(events, {"AUE_EXECVE", "AUE_CLOSE"},
+                                  class_bit, mappings, unknown));
+  CHECK(unknown == "AUE_CLOSE");
+
+  CHECK(knox::profileMappings(events, {"AUE_EXECVE", "AUE_FORK"}, class_bit,
+                              mappings, unknown));
+  CHECK(mappings.size() == 2);
+  CHECK(mappings[0].ec_number == 23 && mappings[0].ec_class == 0x40000084);
+  CHECK(mappings[1].ec_number == 2 && mappings[1].ec_class == 0x84);
+
+  // Nothing has the bit before profiling, so there's nothing to unprofile.
+  CHECK(knox::unprofileMappings(events, class_bit).empty());
+
+  // Apply the profile, as the kernel would, then undo it.
+  for (auto &evc_map : mappings) {
+    for (auto &event : events) {
+      if (event.number == evc_map.ec_number) {
+        event.mask = evc_map.ec_class;
+      }
+    }
+  }
+  CHECK(knox::unusedClassBit(classes, events) == 0x8);
+  auto restore = knox::unprofileMappings(events, class_bit);
+  CHECK(restore.size() == 2);
+  CHECK(restore[0].ec_number == 2 && restore[0].ec_class == 0x80);
+  CHECK(restore[1].ec_number == 23 && restore[1].ec_class == 0x40000080);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("classes: ok\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// Checks knox::ProcessCache: generations, erasing with backward shifts, and
+// CLOCK eviction.
+//
+// usage: test/processes
+
+#include "knox/processes.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+#define CHECK(CONDITION)                                                       \
+  if (not(CONDITION)) {                                                        \
+    fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #CONDITION);     \
+    ++failures;                                                                \
+  }
+
+int main() {
+  {
+    knox::ProcessCache<int> cache{4};
+    CHECK(cache.capacity() == 4);
+    CHECK(not cache.find(100));
+
+    cache.insert(100, 10, 1);
+    auto entry = cache.find(100);
+    CHECK(entry && entry->pid == 100 && entry->generation == 10 &&
+          entry->state == 1);
+
+    // Insert replaces, rather than adding another entry.
+    cache.insert(100, 20, 2);
+    CHECK(cache.size() == 1);
+    CHECK(cache.find(100)->state == 2);
+
+    // An older generation is of a previous process with the pid.
+    CHECK(cache.find(100, 20));
+    CHECK(not cache.find(100, 30));
+    CHECK(not cache.find(100));
+    CHECK(cache.size() == 0);
+
+    cache.erase(100);
+    CHECK(cache.size() == 0);
+  }
+
+  {
+    // Erasing shifts back the entries that probed past the erased one, so
+    // the rest are still found, whatever the collisions.
+    const pid_t count = 512;
+    knox::ProcessCache<pid_t> cache{count};
+    for (pid_t pid = 1; pid <= count; ++pid) {
+      cache.insert(pid, 0, pid);
+    }
+    for (pid_t pid = 1; pid <= count; pid += 2) {
+      cache.erase(pid);
+    }
+    CHECK(cache.size() == count / 2);
+    for (pid_t pid = 1; pid <= count; ++pid) {
+      auto entry = cache.find(pid);
+      CHECK(pid % 2 == 1 ? not entry : entry && entry->state == pid);
+    }
+
+    // Freed slots are reused, without evicting.
+    for (pid_t pid = count + 1; pid <= count + count / 2; ++pid) {
+      cache.insert(pid, 0, pid);
+    }
+    CHECK(cache.size() == count);
+    CHECK(cache.evictions() == 0);
+  }
+
+  {
+    // When full, the clock hand clears references, and evicts the first
+    // entry not referenced since it last passed.
+    knox::ProcessCache<int> cache{3};
+    cache.insert(1, 0, 1);
+    cache.insert(2, 0, 2);
+    cache.insert(3, 0, 3);
+    cache.insert(4, 0, 4);
+    CHECK(cache.evictions() == 1);
+    CHECK(not cache.find(1));
+
+    // 2 is referenced since the hand passed, 3 isn't.
+    CHECK(cache.find(2));
+    cache.insert(5, 0, 5);
+    CHECK(cache.evictions() == 2);
+    CHECK(not cache.find(3));
+    CHECK(cache.find(2) && cache.find(4) && cache.find(5));
+    CHECK(cache.size() == 3);
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("processes: ok\n");
+  return EXIT_SUCCESS;
+}